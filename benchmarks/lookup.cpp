@@ -0,0 +1,77 @@
+#include <dependency_resolver.hpp>
+#include <chrono>
+#include <cstdio>
+#include <typeindex>
+
+using jaszyk::dependency_resolver_impl::utility::perfect_hash_map;
+using jaszyk::dependency_resolver_impl::utility::service_key;
+using jaszyk::dependency_resolver_impl::utility::type_id_of;
+
+template <std::size_t N>
+struct registered { };
+
+template <std::size_t... Ns>
+std::vector<std::pair<service_key, std::size_t>> make_keys(std::index_sequence<Ns...>) {
+    return { { type_id_of<registered<Ns>>(), Ns }... };
+}
+
+template <std::size_t... Ns>
+std::vector<std::type_index> make_type_indices(std::index_sequence<Ns...>) {
+    return { typeid(registered<Ns>)... };
+}
+
+// nanoseconds per lookup, over all keys in random order
+template <typename TKey, typename TLookup>
+double measure(const std::vector<TKey>& order, TLookup lookup) {
+    constexpr int rounds = 200;
+    std::size_t checksum = 0;
+
+    const auto start = std::chrono::steady_clock::now();
+
+    for (int round = 0; round < rounds; ++round) {
+        for (const TKey& key : order) {
+            checksum += lookup(key);
+        }
+    }
+
+    const auto elapsed = std::chrono::steady_clock::now() - start;
+
+    if (checksum == 0) {
+        std::puts("");
+    }
+
+    return std::chrono::duration<double, std::nano>(elapsed).count() / (double(rounds) * order.size());
+}
+
+int main() {
+    const auto all = make_keys(std::make_index_sequence<10000>{});
+    const auto all_type_indices = make_type_indices(std::make_index_sequence<10000>{});
+
+    std::printf("%10s %16s %12s %12s %12s\n", "services", "type_index ns", "map ns", "phf ns", "build us");
+
+    for (std::size_t count : { 10u, 100u, 1000u, 10000u }) {
+        std::vector<std::pair<service_key, std::size_t>> keys(all.begin(), all.begin() + count);
+        std::map<service_key, std::size_t> map(keys.begin(), keys.end());
+
+        const auto start = std::chrono::steady_clock::now();
+        perfect_hash_map<std::size_t> index;
+        index.build(keys);
+        const auto build = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+
+        std::map<std::type_index, std::size_t> type_index_map;
+        std::vector<service_key> order;
+        std::vector<std::type_index> type_index_order;
+
+        for (std::size_t i = 0; i < count; ++i) {
+            type_index_map.insert({ all_type_indices[i], i });
+            order.push_back(keys[(i * 7919) % count].first);
+            type_index_order.push_back(all_type_indices[(i * 7919) % count]);
+        }
+
+        const double type_index_ns = measure(type_index_order, [&](const std::type_index& key) { return type_index_map.find(key)->second; });
+        const double map_ns = measure(order, [&](const service_key& key) { return map.find(key)->second; });
+        const double index_ns = measure(order, [&](const service_key& key) { return *index.find(key); });
+
+        std::printf("%10zu %16.2f %12.2f %12.2f %12.1f\n", count, type_index_ns, map_ns, index_ns, build);
+    }
+}
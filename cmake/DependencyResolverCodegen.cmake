@@ -0,0 +1,40 @@
+# dependency_resolver_generate_wiring(<target>
+#     MANIFEST <manifest header>
+#     OUTPUT <generated header>
+#     [NAMESPACE <namespace>]
+#     [INCLUDE_DIRECTORIES <dirs>...])
+#
+# Builds the wiring generator for the given registration manifest and adds
+# <target>, which produces OUTPUT - a header with a plain `wiring` class
+# constructing every registered service with direct std::make_shared calls.
+# INCLUDE_DIRECTORIES are needed to compile the manifest (service headers).
+
+set(_DEPENDENCY_RESOLVER_ROOT "${CMAKE_CURRENT_LIST_DIR}/..")
+
+function(dependency_resolver_generate_wiring target)
+    cmake_parse_arguments(ARG "" "MANIFEST;OUTPUT;NAMESPACE" "INCLUDE_DIRECTORIES" ${ARGN})
+
+    if(NOT ARG_MANIFEST OR NOT ARG_OUTPUT)
+        message(FATAL_ERROR "dependency_resolver_generate_wiring: MANIFEST and OUTPUT are required")
+    endif()
+
+    if(NOT ARG_NAMESPACE)
+        set(ARG_NAMESPACE generated)
+    endif()
+
+    get_filename_component(manifest "${ARG_MANIFEST}" ABSOLUTE)
+    get_filename_component(output "${ARG_OUTPUT}" ABSOLUTE BASE_DIR "${CMAKE_CURRENT_BINARY_DIR}")
+
+    add_executable(${target}_generator "${_DEPENDENCY_RESOLVER_ROOT}/tools/codegen/generate_wiring.cpp")
+    target_include_directories(${target}_generator PRIVATE "${_DEPENDENCY_RESOLVER_ROOT}/include" ${ARG_INCLUDE_DIRECTORIES})
+    target_compile_definitions(${target}_generator PRIVATE "JASZYK_DEPENDENCY_MANIFEST_HEADER=\"${manifest}\"")
+
+    add_custom_command(
+        OUTPUT "${output}"
+        COMMAND ${target}_generator "${output}" ${ARG_NAMESPACE}
+        DEPENDS ${target}_generator "${manifest}"
+        COMMENT "Generating ${ARG_OUTPUT} from ${ARG_MANIFEST}"
+        VERBATIM)
+
+    add_custom_target(${target} DEPENDS "${output}")
+endfunction()
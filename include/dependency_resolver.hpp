@@ -1,17 +1,39 @@
 #pragma once
 #ifndef __JASZYK_DEPENDENCY_RESOLVER_HPP__
 #define __JASZYK_DEPENDENCY_RESOLVER_HPP__
+#include "dependency_resolver_fwd.hpp"
 #include <memory>
-#include <iostream>
 #include <vector>
-#include <memory>
+#include <mutex>
+#include <functional>
+#include <atomic>
+#include <algorithm>
+#include <cstdint>
 #include <string>
 #include <map>
-#include <typeindex>
+#include <new>
+#include <typeinfo>
 #include <stdexcept>
 #include <type_traits>
 #include <tuple>
 #include <utility>
+#include <chrono>
+#include <exception>
+
+// Define JASZYK_DEPENDENCY_RESOLVER_SEPARATE_COMPILATION in every translation unit
+// (the dependency_resolver CMake target does) to link the non-template core from
+// the dependency_resolver library instead of compiling it inline everywhere.
+#ifdef JASZYK_DEPENDENCY_RESOLVER_SEPARATE_COMPILATION
+#define JASZYK_DEPENDENCY_RESOLVER_DECL
+#else
+#define JASZYK_DEPENDENCY_RESOLVER_DECL inline
+#endif
+
+// Define JASZYK_DEPENDENCY_RESOLVER_DIAGNOSTICS in every translation unit, the
+// dependency_resolver library included, to enable dependency_resolver::add_observer.
+// Without it the tape interpreter has no observer calls at all. The setting selects
+// the inline namespace of the library (see dependency_resolver_fwd.hpp), so mixing
+// settings across translation units fails to link rather than violating the ODR.
 
 #ifdef __GNUC__ // Check if using GCC or Clang
 #pragma GCC diagnostic push
@@ -24,6 +46,7 @@
 
 
 namespace jaszyk {
+inline namespace JASZYK_DEPENDENCY_RESOLVER_ABI {
 namespace dependency_resolver_impl {
 namespace utility {
 
@@ -83,7 +106,7 @@ namespace reflections {
 
     // Here we detect the data type field number. The byproduct is instantiations.
     // Uses list initialization. Won't work for types with user-provided constructors.
-    // In C++17 there is std::is_aggregate which can be added later.
+    // Used for aggregates only, see is_aggregate.
     template <typename T, int... Ns>
     constexpr int fields_number(...) { return sizeof...(Ns) - 1; }
 
@@ -123,6 +146,71 @@ namespace reflections {
     using as_tuple =
         typename loophole_tuple<T, std::make_integer_sequence<int, fields_number_ctor<T>(0)>>::type;
 
+    // As c_op, but converts only to std::shared_ptr. Aggregates are probed with
+    // it, so that fields of other types are never named by loophole, which
+    // returns its type by value.
+    template <typename T, int N>
+    struct shared_op
+    {
+        template <typename U, int M>
+        static auto ins(...) -> int;
+        template <typename U, int M, int = cloophole(tag<T, M>{}) >
+        static auto ins(int) -> char;
+
+        template <typename U, int = sizeof(fn_def<T, std::shared_ptr<U>, N, sizeof(ins<U, N>(0)) == sizeof(char)>)>
+        operator std::shared_ptr<U>();
+    };
+
+    // Number of leading std::shared_ptr fields of an aggregate.
+    template <typename T, int... Ns>
+    constexpr int shared_fields_number(...) { return sizeof...(Ns) - 1; }
+
+    template <typename T, int... Ns>
+    constexpr auto shared_fields_number(int) -> decltype(T{ shared_op<T, Ns>{}... }, 0)
+    {
+        return shared_fields_number<T, Ns..., sizeof...(Ns)>(0);
+    }
+
+    // The leading std::shared_ptr fields of an aggregate as a tuple type.
+    template <typename T>
+    using fields_tuple =
+        typename loophole_tuple<T, std::make_integer_sequence<int, shared_fields_number<T>(0)>>::type;
+
+    // Whether field K of an aggregate is a std::shared_ptr; the fields before it
+    // are probed with c_op, so a field that can't be moved ends the search.
+    template <typename T, int K, int... Ns>
+    constexpr auto shared_field_at(std::integer_sequence<int, Ns...>, int) -> decltype(T{ c_op<T, Ns>{}..., shared_op<T, K>{} }, true)
+    {
+        return true;
+    }
+
+    template <typename T, int K, int... Ns>
+    constexpr bool shared_field_at(std::integer_sequence<int, Ns...>, ...) { return false; }
+
+    template <typename T, int First, int... Ks>
+    constexpr bool any_shared_field(std::integer_sequence<int, Ks...>)
+    {
+        const bool shared[] = { false, shared_field_at<T, First + Ks>(std::make_integer_sequence<int, First + Ks>{}, 0)... };
+
+        for (bool field : shared) {
+            if (field) {
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+    // Whether a std::shared_ptr field of an aggregate follows a field of another type.
+    template <typename T>
+    constexpr bool has_trailing_shared_field()
+    {
+        constexpr int leading = shared_fields_number<T>(0);
+        constexpr int fields = fields_number<T>(0);
+
+        return any_shared_field<T, leading>(std::make_integer_sequence<int, (fields > leading ? fields - leading : 0)>{});
+    }
+
 #ifdef __GNUC__
 #pragma GCC diagnostic pop
 #elif defined(_MSC_VER)
@@ -145,363 +233,2296 @@ namespace reflections {
             : std::runtime_error("Usage of scoped dependency without scope.") { }
     };
 
-    /*
-        </Exception classes>
-    */
-    
-    /*
-        <extensible tuple>
-
-        This class is used to store dependencies in dependency resolver.
-        It allows to store dependencies and resolve them later.
+    class circular_dependency_exception : public std::runtime_error {
+    public:
+        inline circular_dependency_exception()
+            : std::runtime_error("Circular dependency detected while resolving a service.") { }
+    };
 
-        add_singleton<TInterface, TService>(value) - stores singleton value of type TService as TInterface
-            * singleton value is resolved once and stored in tuple
+    class duplicate_registration_exception : public std::runtime_error {
+    public:
+        inline duplicate_registration_exception()
+            : std::runtime_error("Service is already registered in the resolver.") { }
 
-        add_transient<TInterface, TService>() - stores transient value of type TService as TInterface
-            * transient value is resolved every time it is requested
+        // registered - name of the service's implementation
+        inline explicit duplicate_registration_exception(const std::string& registered)
+            : std::runtime_error("Service is already registered in the resolver as " + registered + ".") { }
+    };
 
-        add_scoped<TInterface, TService>() - stores scoped value of type TService as TInterface
-            * scoped value is resolved once and stored in scope
-			* if scope is not provided, missing_scope_exception is thrown
+    class duplicate_decorator_exception : public std::runtime_error {
+    public:
+        // decorator - name of the decorator's type
+        inline explicit duplicate_decorator_exception(const std::string& decorator)
+            : std::runtime_error("Service is already decorated with " + decorator + ".") { }
+    };
 
-        resolve_object<T>([scope]) - resolves object of type T
-			* if object's parameter is not stored in tuple, element_not_found_exception is thrown
+    class scoped_dependency_exception : public std::runtime_error {
+    public:
+        // service - name of the weak-cached service's implementation
+        inline explicit scoped_dependency_exception(const std::string& service)
+            : std::runtime_error("Weak-cached service " + service + " depends on a scoped service.") { }
+    };
 
+    /*
+        </Exception classes>
     */
-    class i_tuple_element;
 
-    class extensible_tuple {
+    /*
+        <service description>
+
+        Services are keyed by the type they are resolved as (std::shared_ptr<T>).
+        constructor_traits<T> describes the injecting constructor of T found by
+        reflections::as_tuple in a type-erased form, so that the resolver can walk
+        the dependency graph without instantiating anything recursively.
+
+        Keys are type_ids rather than std::type_index: a 64-bit FNV-1a hash of the
+        type's name as the compiler spells it in a function signature, computed at
+        compile time. It is the same in every shared object, whether or not their
+        RTTI symbols are merged, and compares as an integer. Shared objects must be
+        built by the same compiler; types of anonymous namespaces with the same
+        name in different translation units share an id.
+    */
+    class type_id {
     public:
-        extensible_tuple();
+        constexpr type_id()
+            : value_(0) { }
 
-        extensible_tuple(const extensible_tuple& other) = delete;
-
-        extensible_tuple(extensible_tuple&& other) noexcept = default;
+        constexpr explicit type_id(std::uint64_t value)
+            : value_(value) { }
 
-        extensible_tuple& operator=(const extensible_tuple& other) = delete;
+        constexpr std::uint64_t value() const {
+            return value_;
+        }
 
-        extensible_tuple& operator=(extensible_tuple&& other) noexcept = default;
+        constexpr std::size_t hash_code() const {
+            return static_cast<std::size_t>(value_);
+        }
 
-        template <typename TInterface, typename TService>
-        void add_singleton(const std::shared_ptr<TService>& value);
+        friend constexpr bool operator==(type_id left, type_id right) {
+            return left.value_ == right.value_;
+        }
 
-        template <typename TInterface, typename TService>
-        void add_transient();
+        friend constexpr bool operator!=(type_id left, type_id right) {
+            return left.value_ != right.value_;
+        }
 
-        template <typename TInterface, typename TService>
-        void add_scoped();
+        friend constexpr bool operator<(type_id left, type_id right) {
+            return left.value_ < right.value_;
+        }
 
-        template <typename T>
-        std::shared_ptr<T> get() const;
+    private:
+        std::uint64_t value_;
+    };
 
-        template <typename T>
-        std::shared_ptr<T> resolve_object() const;
+    constexpr std::uint64_t fnv1a(const char* text) {
+        std::uint64_t hash = 14695981039346656037ull;
 
-        template <typename T, std::size_t... Is>
-        std::shared_ptr<T> resolve_object_helper(std::index_sequence<Is...>) const;
+        for (; *text != '\0'; ++text) {
+            hash = (hash ^ static_cast<unsigned char>(*text)) * 1099511628211ull;
+        }
 
-        template <typename T>
-        std::shared_ptr<T> get(extensible_tuple& scope) const;
+        return hash;
+    }
 
-        template <typename T>
-        std::shared_ptr<T> resolve_object(extensible_tuple& scope) const;
+    template <typename T>
+    constexpr std::uint64_t type_hash() {
+#if defined(_MSC_VER) && !defined(__clang__)
+        return fnv1a(__FUNCSIG__);
+#else
+        return fnv1a(__PRETTY_FUNCTION__);
+#endif
+    }
 
-        template <typename T, std::size_t... Is>
-        std::shared_ptr<T> resolve_object_helper(extensible_tuple& scope, std::index_sequence<Is...>) const;
+    template <typename T>
+    inline type_id type_id_of() {
+        return type_id(std::integral_constant<std::uint64_t, type_hash<T>()>::value);
+    }
 
-        size_t size() const;
+    using service_key = type_id;
 
-        template <typename T>
-        auto find() const;
+    template <typename T>
+    inline service_key key_of() {
+        return type_id_of<std::shared_ptr<T>>();
+    }
 
-        auto end() const;
+    enum class service_lifetime : unsigned char {
+        singleton,
+        transient,
+        scoped,
+        expiring,
+        weak_cached
+    };
 
-    private:
-        template <typename T>
-        std::shared_ptr<T> get_service() const;
+    class extensible_tuple;
 
-        template <typename T>
-        std::shared_ptr<T> get_service(extensible_tuple& scope) const;
+    // registers a service that is missing from the tuple, returns false if it can't
+    using binder_function = bool(*)(extensible_tuple&);
 
-        std::vector<std::unique_ptr<i_tuple_element>> elements_;
-        std::map<std::type_index, i_tuple_element*> type_index_map_;
+    struct dependency {
+        service_key key;
+        binder_function bind;
+        // name of the dependency's type, for diagnostics
+        const char* name;
     };
-    /*==========================*/
 
+    template <template <typename...> class>
+    struct template_key { };
 
-    class i_tuple_element {
-    public:
-        constexpr explicit i_tuple_element(extensible_tuple& my_tuple)
-            : my_tuple_(my_tuple) { }
+    template <typename...>
+    struct make_void {
+        using type = void;
+    };
 
-        inline virtual ~i_tuple_element() = default;
-    protected:
-        extensible_tuple& my_tuple_;
+    template <typename T, typename = void>
+    struct dependency_binder {
+        static constexpr binder_function get() {
+            return nullptr;
+        }
     };
 
+    template <typename T>
+    inline dependency dependency_of() {
+        return { key_of<T>(), dependency_binder<T>::get(), typeid(T).name() };
+    }
 
+    inline const std::vector<dependency>& no_dependencies() {
+        static const std::vector<dependency> none;
+        return none;
+    }
 
-    template <typename T>
-    class tuple_element_base : public i_tuple_element {
-        using base = i_tuple_element;
-    protected:
-        using base::my_tuple_;
-    public:
-        constexpr explicit tuple_element_base(extensible_tuple& my_tuple)
-            : base(my_tuple) { }
+    // declared signature of an injecting constructor, see injection_constructor
+    template <typename... TArgs>
+    struct inject {
+        using arguments = std::tuple<TArgs...>;
+        static constexpr bool aggregate = false;
+    };
 
-        inline virtual ~tuple_element_base() = default;
-        inline virtual std::shared_ptr<T> value(extensible_tuple& context) = 0;
-        inline virtual std::shared_ptr<T> value() = 0;
+    // C++14 has no std::is_aggregate, the builtin behind it is available in GCC, Clang and MSVC
+    template <typename T>
+    struct is_aggregate : std::integral_constant<bool, __is_aggregate(T)> { };
+
+    template <bool...>
+    struct bool_pack { };
+
+    // Aggregates are brace-initialized with dependencies for their leading
+    // std::shared_ptr fields, the other fields keep their default member
+    // initializers; aggregates without such fields are value-initialized.
+    // A std::shared_ptr field after a field of another type would be left
+    // empty, such aggregates are rejected. Constructors of the remaining types
+    // are probed.
+    template <typename T, bool = is_aggregate<T>::value>
+    struct probed_constructor {
+        using arguments = reflections::as_tuple<T>;
+        static constexpr bool aggregate = false;
     };
 
+    template <typename T>
+    struct probed_constructor<T, true> {
+        static_assert(!reflections::has_trailing_shared_field<T>(),
+            "std::shared_ptr fields of an aggregate are injected only before its other fields; move them first or declare an injection constructor.");
 
+        using arguments = reflections::fields_tuple<T>;
+        static constexpr bool aggregate = std::tuple_size<arguments>::value != 0;
+    };
 
-    template <typename TInterface, typename TService>
-    class singleton_tuple_element : public tuple_element_base<TInterface> {
-        using base = tuple_element_base<TInterface>;
-        using base::my_tuple_;
-    public:
-        constexpr explicit singleton_tuple_element(extensible_tuple& my_tuple, const std::shared_ptr<TService>& value)
-            : base(my_tuple), value_(value) { }
+    // probed unless T declares its constructor with
+    // using injection_constructor = inject<std::shared_ptr<TArgs>...>;
+    template <typename T, typename = void>
+    struct member_injection_constructor : probed_constructor<T> { };
 
-        inline std::shared_ptr<TInterface> value(extensible_tuple&) override {
-            return value_;
-        }
+    template <typename T>
+    struct member_injection_constructor<T, typename make_void<typename T::injection_constructor>::type>
+        : T::injection_constructor { };
 
-        inline std::shared_ptr<TInterface> value() override {
-            return value_;
-        }
+    // specialized by JASZYK_INJECTION_CONSTRUCTOR for types that can't declare the alias
+    template <typename T>
+    struct injection_constructor : member_injection_constructor<T> { };
 
-    private:
-        std::shared_ptr<TInterface> value_;
-    };
+    template <typename T, typename TArguments>
+    struct is_injectable;
 
+    template <typename T, typename... TArgs>
+    struct is_injectable<T, std::tuple<TArgs...>> : std::is_constructible<T, TArgs...> { };
 
+    // Lifecycle hooks: void on_created() runs once the resolver has constructed
+    // the service, void on_disposed() right before it is destroyed. Both are
+    // found at compile time; types without them are built by a plain make_shared.
+    template <typename T, typename = void>
+    struct has_on_created : std::false_type { };
 
-    template <typename TInterface, typename TService>
-    class transient_tuple_element : public tuple_element_base<TInterface> {
-        using base = tuple_element_base<TInterface>;
-        using base::my_tuple_;
-    public:
-        constexpr explicit transient_tuple_element(extensible_tuple& my_tuple)
-            : base(my_tuple) { }
+    template <typename T>
+    struct has_on_created<T, typename make_void<decltype(std::declval<T&>().on_created())>::type> : std::true_type { };
 
-        inline std::shared_ptr<TInterface> value(extensible_tuple& context) override {
-            return my_tuple_.template resolve_object<TService>(context);
-        }
+    template <typename T, typename = void>
+    struct has_on_disposed : std::false_type { };
 
-        inline std::shared_ptr<TInterface> value() override {
-            return my_tuple_.template resolve_object<TService>();
-        }
-    };
+    template <typename T>
+    struct has_on_disposed<T, typename make_void<decltype(std::declval<T&>().on_disposed())>::type> : std::true_type { };
 
+    // Services deriving from std::enable_shared_from_this: only a std::shared_ptr
+    // owning the service itself sets it up, so they can't live in a holder.
+    template <typename T, typename = void>
+    struct shares_from_this : std::false_type { };
 
+    template <typename T>
+    struct shares_from_this<T, typename make_void<decltype(std::declval<T&>().shared_from_this())>::type> : std::true_type { };
 
-    template <typename TInterface, typename TService>
-    class scoped_tuple_element : public tuple_element_base<TInterface> {
-        using base = tuple_element_base<TInterface>;
-        using base::my_tuple_;
-    public:
-        constexpr explicit scoped_tuple_element(extensible_tuple& my_tuple)
-            : base(my_tuple) { }
+    // Aggregates are brace-initialized with their leading std::shared_ptr fields
+    // only, the others are left to their default member initializers on purpose.
+#ifdef __GNUC__
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmissing-field-initializers"
+#endif
 
-        inline std::shared_ptr<TInterface> value(extensible_tuple& context) override {
-            auto it = context.find<TService>();
+    // Shares the allocation with the service, which is handed out through an
+    // aliasing std::shared_ptr; enable_shared_from_this is not set up for it.
+    // Used for aggregates, which make_shared can't brace-initialize in place,
+    // and for services with on_disposed().
+    template <typename TService, bool Disposing>
+    struct service_holder {
+        template <typename... TArgs>
+        explicit service_holder(std::false_type, TArgs&&... args)
+            : value(std::forward<TArgs>(args)...) { }
+
+        template <typename... TArgs>
+        explicit service_holder(std::true_type, TArgs&&... args)
+            : value{ std::forward<TArgs>(args)... } { }
+
+        TService value;
+    };
 
-            if (it == context.end()) {
-                context.add_singleton<TService, TService>(my_tuple_.template resolve_object<TService>(context));
-            }
+    template <typename TService>
+    struct service_holder<TService, true> : service_holder<TService, false> {
+        using service_holder<TService, false>::service_holder;
 
-            return context.get<TService>(context);
+        ~service_holder() {
+            this->value.on_disposed();
         }
+    };
 
-        inline std::shared_ptr<TInterface> value() override {
-            throw missing_scope_exception();
+    // Deleter of services allocated on their own, see self_owned
+    template <typename TService, bool Disposing>
+    struct service_deleter {
+        void operator()(TService* service) const {
+            delete service;
         }
     };
 
+    template <typename TService>
+    struct service_deleter<TService, true> {
+        void operator()(TService* service) const {
+            service->on_disposed();
+            delete service;
+        }
+    };
 
+    // Allocation of services that share themselves but would need a holder:
+    // a separate control block whose deleter runs on_disposed().
+    template <bool Disposing>
+    struct self_owned { };
 
-    inline extensible_tuple::extensible_tuple() {
-        elements_.reserve(4);
+    // TAggregate - brace-initialize, TDisposing - TService has on_disposed()
+    template <typename TService, typename... TArgs>
+    inline std::shared_ptr<TService> allocate_service(std::false_type, std::false_type, TArgs&&... args) {
+        return std::make_shared<TService>(std::forward<TArgs>(args)...);
     }
 
-    template <typename TInterface, typename TService>
-    inline void extensible_tuple::add_singleton(const std::shared_ptr<TService>& value) {
-        elements_.push_back(std::make_unique<singleton_tuple_element<TInterface, TService>>(*this, value));
-        type_index_map_.insert({ typeid(std::shared_ptr<TInterface>), elements_.back().get() });
+    template <typename TService, typename TAggregate, typename TDisposing, typename... TArgs>
+    inline std::shared_ptr<TService> allocate_service(TAggregate aggregate, TDisposing, TArgs&&... args) {
+        auto holder = std::make_shared<service_holder<TService, TDisposing::value>>(aggregate, std::forward<TArgs>(args)...);
+        return std::shared_ptr<TService>(holder, &holder->value);
     }
 
-    template <typename TInterface, typename TService>
-    inline void extensible_tuple::add_transient() {
-        elements_.push_back(std::make_unique<transient_tuple_element<TInterface, TService>>(*this));
-        type_index_map_.insert({ typeid(std::shared_ptr<TInterface>), elements_.back().get() });
+    template <typename TService, bool Disposing, typename... TArgs>
+    inline std::shared_ptr<TService> allocate_service(std::false_type, self_owned<Disposing>, TArgs&&... args) {
+        return std::shared_ptr<TService>(new TService(std::forward<TArgs>(args)...), service_deleter<TService, Disposing>());
     }
 
-    template <typename TInterface, typename TService>
-    inline void extensible_tuple::add_scoped() {
-        elements_.push_back(std::make_unique<scoped_tuple_element<TInterface, TService>>(*this));
-        type_index_map_.insert({ typeid(std::shared_ptr<TInterface>), elements_.back().get() });
+    template <typename TService, bool Disposing, typename... TArgs>
+    inline std::shared_ptr<TService> allocate_service(std::true_type, self_owned<Disposing>, TArgs&&... args) {
+        return std::shared_ptr<TService>(new TService{ std::forward<TArgs>(args)... }, service_deleter<TService, Disposing>());
     }
 
-    template <typename T>
-    inline std::shared_ptr<T> extensible_tuple::get() const {
-        return get_service<T>();
-    }
+#ifdef __GNUC__
+#pragma GCC diagnostic pop
+#endif
 
-    template <typename T>
-    inline std::shared_ptr<T> extensible_tuple::resolve_object() const {
-        using tuple_type = jaszyk::dependency_resolver_impl::utility::reflections::as_tuple<T>;
-        return resolve_object_helper<T>(std::make_index_sequence<std::tuple_size<tuple_type>::value>{});
-    }
+    template <typename TService>
+    inline void notify_created(TService&, std::false_type) { }
 
-    template <typename T, std::size_t... Is>
-    inline std::shared_ptr<T> extensible_tuple::resolve_object_helper(std::index_sequence<Is...>) const {
-        return std::make_shared<T>(get<typename std::tuple_element_t<Is, jaszyk::dependency_resolver_impl::utility::reflections::as_tuple<T>>::element_type>()...);
+    template <typename TService>
+    inline void notify_created(TService& service, std::true_type) {
+        service.on_created();
     }
 
-    template <typename T>
-    inline std::shared_ptr<T> extensible_tuple::get(extensible_tuple& scope) const {
-        return get_service<T>(scope);
+    template <typename TService, typename TAggregate, typename... TArgs>
+    inline std::shared_ptr<TService> create_service(TAggregate aggregate, TArgs&&... args) {
+        constexpr bool disposing_service = has_on_disposed<TService>::value;
+        using disposing = typename std::conditional<
+            shares_from_this<TService>::value && (disposing_service || TAggregate::value),
+            self_owned<disposing_service>,
+            std::integral_constant<bool, disposing_service>>::type;
+
+        auto service = allocate_service<TService>(aggregate, disposing{}, std::forward<TArgs>(args)...);
+        notify_created(*service, has_on_created<TService>{});
+        return service;
     }
 
-    template <typename T>
-    inline std::shared_ptr<T> extensible_tuple::resolve_object(extensible_tuple& scope) const {
-        using tuple_type = jaszyk::dependency_resolver_impl::utility::reflections::as_tuple<T>;
-        return resolve_object_helper<T>(scope, std::make_index_sequence<std::tuple_size<tuple_type>::value>{});
-    }
+    template <typename TService>
+    struct constructor_traits {
+        using arguments = typename injection_constructor<TService>::arguments;
 
-    template <typename T, std::size_t... Is>
-    inline std::shared_ptr<T> extensible_tuple::resolve_object_helper(extensible_tuple& scope, std::index_sequence<Is...>) const {
-        return std::make_shared<T>(get<typename std::tuple_element_t<Is, jaszyk::dependency_resolver_impl::utility::reflections::as_tuple<T>>::element_type>(scope)...);
-    }
+        // built as TService{ fields... } rather than TService(arguments...)
+        static constexpr bool aggregate = injection_constructor<TService>::aggregate;
 
-    inline size_t extensible_tuple::size() const {
-        return type_index_map_.size();
-    }
+        static_assert(aggregate || is_injectable<TService, arguments>::value, "The injection constructor is not a constructor of the service.");
 
-    template <typename T>
-    inline auto extensible_tuple::find() const {
-        return type_index_map_.find(typeid(std::shared_ptr<T>));
-    }
+        template <std::size_t I>
+        using argument_t = typename std::tuple_element_t<I, arguments>::element_type;
 
-    inline auto extensible_tuple::end() const {
-		return type_index_map_.end();
-	}
+        static constexpr std::size_t arity = std::tuple_size<arguments>::value;
 
-    template <typename T>
-    inline std::shared_ptr<T> extensible_tuple::get_service() const {
-        auto it = type_index_map_.find(typeid(std::shared_ptr<T>));
+        // constructor parameters, in declaration order
+        static const std::vector<dependency>& dependencies() {
+            static const std::vector<dependency> parameters = make_dependencies(std::make_index_sequence<arity>{});
+            return parameters;
+        }
 
-        if (it == type_index_map_.end()) {
-            throw element_not_found_exception();
+        // args[i] holds a pointer of type argument_t<i>
+        static std::shared_ptr<TService> construct(std::shared_ptr<void>* args) {
+            return construct_helper(args, std::make_index_sequence<arity>{});
         }
 
-        return static_cast<tuple_element_base<T>*>(it->second)->value();
-    }
+        static std::shared_ptr<void> construct_erased(std::shared_ptr<void>* args) {
+            return construct(args);
+        }
 
-    template <typename T>
-    inline std::shared_ptr<T> extensible_tuple::get_service(extensible_tuple& scope) const {
+    private:
+        template <std::size_t... Is>
+        static std::vector<dependency> make_dependencies(std::index_sequence<Is...>) {
+            return { dependency_of<argument_t<Is>>()... };
+        }
+
+        template <std::size_t... Is>
+        static std::shared_ptr<TService> construct_helper(std::shared_ptr<void>* args, std::index_sequence<Is...>) {
+            (void)args;
+            return create_service<TService>(std::integral_constant<bool, aggregate>{},
+                std::static_pointer_cast<argument_t<Is>>(std::move(args[Is]))...);
+        }
+    };
+
+    /*
+        Decorators take the service they wrap as a constructor parameter of the
+        decorated interface. decorate<TInterface, TDecorator>() moves the binding
+        of TInterface to the key of decorated<TInterface, TDecorator> and binds
+        TDecorator in its place, with the wrapped parameter looked up under that
+        key. Every layer is an ordinary service, so the tape compiler inlines the
+        whole chain into the tapes of its consumers; undecorated services are
+        compiled exactly as before.
+    */
+    template <typename TInterface, typename TDecorator>
+    struct decorated { };
+
+    template <typename TInterface, typename TDecorator>
+    struct decorator_traits {
+        static const std::vector<dependency>& dependencies() {
+            static const std::vector<dependency> parameters = make_dependencies();
+            return parameters;
+        }
 
-        auto it = type_index_map_.find(typeid(std::shared_ptr<T>));
+    private:
+        static std::vector<dependency> make_dependencies() {
+            std::vector<dependency> parameters = constructor_traits<TDecorator>::dependencies();
 
-        if (it == type_index_map_.end()) {
-            throw element_not_found_exception();
+            for (dependency& parameter : parameters) {
+                if (parameter.key == key_of<TInterface>()) {
+                    parameter = { key_of<decorated<TInterface, TDecorator>>(), nullptr, parameter.name };
+                }
+            }
+
+            return parameters;
         }
+    };
 
-        return static_cast<tuple_element_base<T>*>(it->second)->value(scope);
-    }
+    template <typename T, typename TArguments>
+    struct takes_argument;
+
+    template <typename T, typename... TArgs>
+    struct takes_argument<T, std::tuple<TArgs...>>
+        : std::integral_constant<bool, !std::is_same<bool_pack<false, std::is_same<T, TArgs>::value...>, bool_pack<std::is_same<T, TArgs>::value..., false>>::value> { };
 
     /*
-        </extensible tuple>
+        </service description>
     */
 
-} // namespace utility
-} // namespace dependency_resolver_impl
+    /*
+        <expiring services>
+
+        An expiring service is built when registered and rebuilt once its ttl is
+        over. Its current instance is published in one of two slots, read as
+        concurrent_resolver reads its versions: a resolve loads the current slot
+        and announces itself in its counter, and never waits for the rebuild.
+        The previous instance is released once the resolves reading it are done.
+
+        Registering an expiring service starts the refresher of the tuple, a
+        thread that rebuilds every expiring service a quarter of its ttl ahead of
+        expiry and is stopped when the tuple is destroyed. The thread refers to
+        the tuple; moving the tuple pauses it before the rest moves and hands it
+        to the moved-to tuple, and a clone starts its own.
+        refresh_expiring() rebuilds every expiring service on the calling thread.
+
+        A failed rebuild keeps the previous instance; the refresher retries it a
+        quarter of ttl later.
+
+        The rebuilds run tapes on the refresher thread while the tuple may be
+        registering services. Registrations take the lock of the tape cache,
+        and the ones that drop tapes or move entries first wait for the tapes
+        being rebuilt from (see tape_cache::pin).
+    */
+    using expiring_function = std::shared_ptr<void>(*)(const extensible_tuple&);
 
-    class dependency_resolver {
-        using extensible_tuple = ::jaszyk::dependency_resolver_impl::utility::extensible_tuple;
-        class scope_type : public extensible_tuple { };
+    struct expiring_service {
+        inline std::shared_ptr<void> load() {
+            for (;;) {
+                const std::size_t slot = current.load();
+                readers[slot].fetch_add(1);
+
+                if (current.load() == slot) {
+                    std::shared_ptr<void> instance = instances[slot];
+                    readers[slot].fetch_sub(1);
+                    return instance;
+                }
+
+                readers[slot].fetch_sub(1);
+            }
+        }
+
+        // called by one thread at a time; the other slot is empty and unread
+        void publish(std::shared_ptr<void> instance);
+
+        std::shared_ptr<void> instances[2];
+        std::atomic<std::size_t> current{ 0 };
+        // resolves reading each slot
+        std::atomic<std::size_t> readers[2]{};
+        // steady_clock ticks
+        std::atomic<std::chrono::steady_clock::rep> expires{ 0 };
+        std::chrono::steady_clock::duration ttl{};
+        expiring_function build = nullptr;
+    };
+
+    // thread rebuilding the services of a tuple before they expire, see the .ipp
+    struct expiring_refresher;
+
+    // Refresher of a tuple, handed over when the tuple moves, see expiring services
+    class refresher_slot {
     public:
-        using scope = scope_type;
+        refresher_slot();
+        refresher_slot(refresher_slot&& other) noexcept;
+        refresher_slot& operator=(refresher_slot&& other) noexcept;
+        ~refresher_slot();
 
-        struct temporary_scope {};
+        // joins the thread; a closed slot doesn't start another one
+        void stop();
 
-        static scope global_scope;
+        // lets a refresher taken over by a move rebuild from owner
+        void resume(const extensible_tuple* owner);
 
-        using dependency_not_found_exception = ::jaszyk::dependency_resolver_impl::utility::element_not_found_exception;
+        std::mutex mutex;
+        bool closed = false;
+        std::unique_ptr<expiring_refresher> refresher;
 
-        using missing_scope_exception = ::jaszyk::dependency_resolver_impl::utility::missing_scope_exception;
+    private:
+        // closes the slot and releases its refresher once it isn't rebuilding
+        std::unique_ptr<expiring_refresher> pause();
+    };
 
-        inline dependency_resolver() = default;
+    /*
+        </expiring services>
+    */
 
-        inline dependency_resolver(const dependency_resolver& other) = delete;
+    /*
+        <weak-cached services>
+
+        A weak-cached service is built like a transient, but the entry keeps a
+        weak_ptr to the last instance and hands it out while anyone holds it. It
+        is rebuilt, with its dependencies, once all holders have released it.
+        The instance is shared across scopes, so a tape reaching a scoped
+        service through it throws scoped_dependency_exception when compiled.
+        Threads that rebuild it at the same time all get the instance stored
+        first.
+
+        A released instance is destroyed as usual; only the storage of one
+        allocated together with its control block stays until the next rebuild.
+    */
+    struct weak_cache {
+        std::mutex mutex;
+        std::weak_ptr<void> instance;
+    };
 
-        inline dependency_resolver(dependency_resolver&& other) noexcept = default;
+    /*
+        </weak-cached services>
+    */
 
-        inline dependency_resolver& operator=(const dependency_resolver& other) = delete;
+    /*
+        <service table>
+
+        Every registration owns one entry of the service table, which holds only
+        what the tape interpreter needs: lifetime, type-erased factory and either
+        the singleton instance, the state of an expiring or weak-cached service or
+        the cast and scope slot of a scoped service.
+        An entry takes half a cache line. Everything else (dependencies, names,
+        sizes) is cold and kept aside in service_metadata.
+
+        Entries are stored in chunks aligned to a cache line and never move once
+        added, so tapes refer to them directly and services registered while
+        resolving (see open generics) don't disturb running tapes.
+
+        Scoped instances are stored in scope slots shared by all registrations of
+        the same implementation type; cast turns the stored implementation pointer
+        into the registered interface.
+    */
+    using factory_function = std::shared_ptr<void>(*)(std::shared_ptr<void>*);
 
-        inline dependency_resolver& operator=(dependency_resolver&& other) noexcept = default;
+    using cast_function = std::shared_ptr<void>(*)(const std::shared_ptr<void>&);
 
-        template <typename TInterface, typename TService>
-        inline void add_singleton(const TService& value) {
-            static_assert(!std::is_abstract<TService>::value, "Cannot register abstract type.");
-            data_.add_singleton<TInterface, TService>(std::make_shared<TService>(value));
-        }
+    using dependencies_function = const std::vector<dependency>&(*)();
 
-        template <typename TService>
-        inline void add_singleton(const TService& value) {
-			static_assert(!std::is_abstract<TService>::value, "Cannot register abstract type.");
-			data_.add_singleton<TService, TService>(std::make_shared<TService>(value));
-		}
+    class service_entry {
+    public:
+        static inline service_entry singleton(std::shared_ptr<void> instance) {
+            service_entry entry(service_lifetime::singleton, nullptr);
+            new (&entry.instance_) std::shared_ptr<void>(std::move(instance));
+            return entry;
+        }
 
-        template <typename TService>
-        inline void add_singleton() {
-            static_assert(!std::is_abstract<TService>::value, "Cannot register abstract type.");
-            data_.add_singleton<TService, TService>(data_.resolve_object<TService>());
+        static inline service_entry expiring(std::shared_ptr<expiring_service> service) {
+            service_entry entry(service_lifetime::expiring, nullptr);
+            new (&entry.instance_) std::shared_ptr<void>(std::move(service));
+            return entry;
         }
 
-        template <typename TInterface, typename TService>
-        inline void add_singleton() {
-            static_assert(!std::is_abstract<TService>::value, "Cannot register abstract type.");
-            data_.add_singleton<TInterface, TService>(data_.resolve_object<TService>());
+        static inline service_entry weak_cached(factory_function factory) {
+            service_entry entry(service_lifetime::weak_cached, factory);
+            new (&entry.instance_) std::shared_ptr<void>(std::make_shared<weak_cache>());
+            return entry;
         }
 
-        template <typename TService>
-        inline void add_transient() {
-            static_assert(!std::is_abstract<TService>::value, "Cannot register abstract type.");
-            data_.add_transient<TService, TService>();
+        static inline service_entry transient(factory_function factory) {
+            service_entry entry(service_lifetime::transient, factory);
+            entry.scoped_ = { nullptr, 0 };
+            return entry;
         }
 
-        template <typename TInterface, typename TService>
-        inline void add_transient() {
-            static_assert(!std::is_abstract<TService>::value, "Cannot register abstract type.");
-            data_.add_transient<TInterface, TService>();
+        static inline service_entry scoped(factory_function factory, cast_function cast, std::size_t slot) {
+            service_entry entry(service_lifetime::scoped, factory);
+            entry.scoped_ = { cast, slot };
+            return entry;
         }
 
-        template <typename TService>
-        inline void add_scoped() {
-            static_assert(!std::is_abstract<TService>::value, "Cannot register abstract type.");
-            data_.add_scoped<TService, TService>();
+        inline service_entry(const service_entry& other)
+            : factory_(other.factory_), lifetime_(other.lifetime_)
+        {
+            if (holds_instance()) {
+                new (&instance_) std::shared_ptr<void>(other.instance_);
+            }
+            else {
+                scoped_ = other.scoped_;
+            }
         }
 
-        template <typename TInterface, typename TService>
-        inline void add_scoped() {
-            static_assert(!std::is_abstract<TService>::value, "Cannot register abstract type.");
-			data_.add_scoped<TInterface, TService>();
-		}
+        inline service_entry(service_entry&& other) noexcept
+            : factory_(other.factory_), lifetime_(other.lifetime_)
+        {
+            if (holds_instance()) {
+                new (&instance_) std::shared_ptr<void>(std::move(other.instance_));
+            }
+            else {
+                scoped_ = other.scoped_;
+            }
+        }
 
-        template <typename T>
-        inline std::shared_ptr<T> resolve(scope& scope) const {
-            return data_.resolve_object<T>(static_cast<extensible_tuple&>(scope));
+        inline service_entry& operator=(const service_entry& other) {
+            return *this = service_entry(other);
         }
 
-        template <typename T>
+        inline service_entry& operator=(service_entry&& other) noexcept {
+            if (this != &other) {
+                this->~service_entry();
+                new (this) service_entry(std::move(other));
+            }
+
+            return *this;
+        }
+
+        inline ~service_entry() {
+            if (holds_instance()) {
+                instance_.~shared_ptr();
+            }
+        }
+
+        inline service_lifetime lifetime() const {
+            return lifetime_;
+        }
+
+        inline factory_function factory() const {
+            return factory_;
+        }
+
+        inline const std::shared_ptr<void>& instance() const {
+            return instance_;
+        }
+
+        inline expiring_service& expiring() const {
+            return *static_cast<expiring_service*>(instance_.get());
+        }
+
+        inline weak_cache& cache() const {
+            return *static_cast<weak_cache*>(instance_.get());
+        }
+
+        inline cast_function cast() const {
+            return scoped_.cast;
+        }
+
+        inline std::size_t scope_slot() const {
+            return scoped_.slot;
+        }
+
+    private:
+        struct scoped_service {
+            cast_function cast;
+            std::size_t slot;
+        };
+
+        inline service_entry(service_lifetime lifetime, factory_function factory)
+            : factory_(factory), lifetime_(lifetime) { }
+
+        inline bool holds_instance() const {
+            return lifetime_ == service_lifetime::singleton || lifetime_ == service_lifetime::expiring
+                || lifetime_ == service_lifetime::weak_cached;
+        }
+
+        factory_function factory_;
+        service_lifetime lifetime_;
+
+        union {
+            std::shared_ptr<void> instance_;
+            scoped_service scoped_;
+        };
+    };
+
+    constexpr std::size_t cache_line_size() { return 64; }
+
+    static_assert(cache_line_size() % sizeof(service_entry) == 0, "Service entries must not straddle cache lines.");
+
+    class service_table {
+    public:
+        inline service_table() = default;
+
+        service_table(const service_table& other) = delete;
+
+        inline service_table(service_table&& other) noexcept
+            : chunks_(std::move(other.chunks_)), size_(other.size_)
+        {
+            other.size_ = 0;
+        }
+
+        service_table& operator=(const service_table& other) = delete;
+
+        inline service_table& operator=(service_table&& other) noexcept {
+            if (this != &other) {
+                clear();
+                chunks_ = std::move(other.chunks_);
+                size_ = other.size_;
+                other.size_ = 0;
+            }
+
+            return *this;
+        }
+
+        inline ~service_table() {
+            clear();
+        }
+
+        inline service_entry& operator[](std::size_t index) {
+            return chunks_[index / chunk_size].entries[index % chunk_size];
+        }
+
+        inline const service_entry& operator[](std::size_t index) const {
+            return chunks_[index / chunk_size].entries[index % chunk_size];
+        }
+
+        inline std::size_t size() const {
+            return size_;
+        }
+
+        inline std::size_t bytes() const {
+            return chunks_.capacity() * sizeof(chunk) + chunks_.size() * (chunk_size * sizeof(service_entry) + cache_line_size());
+        }
+
+        inline service_entry& push_back(service_entry entry) {
+            if (size_ == chunks_.size() * chunk_size) {
+                chunks_.reserve(chunks_.size() + 1);
+                chunks_.push_back(allocate_chunk());
+            }
+
+            service_entry* slot = &(*this)[size_];
+            new (slot) service_entry(std::move(entry));
+            ++size_;
+
+            return *slot;
+        }
+
+    private:
+        static constexpr std::size_t chunk_size = 64;
+
+        struct chunk {
+            void* memory;
+            service_entry* entries;
+        };
+
+        // operator new of C++14 doesn't align beyond max_align_t
+        static inline chunk allocate_chunk() {
+            void* memory = ::operator new(chunk_size * sizeof(service_entry) + cache_line_size());
+            const auto address = (reinterpret_cast<std::uintptr_t>(memory) + cache_line_size() - 1) & ~(cache_line_size() - 1);
+            return { memory, reinterpret_cast<service_entry*>(address) };
+        }
+
+        inline void clear() {
+            for (std::size_t index = 0; index < size_; ++index) {
+                (*this)[index].~service_entry();
+            }
+
+            for (const chunk& allocated : chunks_) {
+                ::operator delete(allocated.memory);
+            }
+
+            chunks_.clear();
+            size_ = 0;
+        }
+
+        std::vector<chunk> chunks_;
+        std::size_t size_ = 0;
+    };
+
+    struct service_metadata {
+        dependencies_function dependencies;
+        // sizeof the singleton instance, 0 for other lifetimes
+        std::size_t instance_size;
+        // name of the implementation type, for diagnostics
+        const char* name;
+    };
+
+    template <typename TInterface, typename TService>
+    inline std::shared_ptr<void> make_service(std::shared_ptr<void>* args) {
+        return std::shared_ptr<TInterface>(constructor_traits<TService>::construct(args));
+    }
+
+    template <typename TInterface, typename TService>
+    inline std::shared_ptr<void> cast_service(const std::shared_ptr<void>& value) {
+        return std::shared_ptr<TInterface>(std::static_pointer_cast<TService>(value));
+    }
+
+    // services stored in each slot of a scope; shared by the versions of the
+    // registrations and replaced, never modified, when a scoped service is added
+    struct scope_layout {
+        std::vector<type_id> types;
+        std::vector<std::size_t> sizes;
+    };
+
+    class scope_storage {
+    public:
+        inline std::shared_ptr<void>& slot(std::size_t index) {
+            if (index >= slots_.size()) {
+                slots_.resize(index + 1);
+            }
+
+            return slots_[index];
+        }
+
+        inline const std::vector<std::shared_ptr<void>>& slots() const {
+            return slots_;
+        }
+
+        // layout the slots were filled with, null while the scope is empty
+        inline const scope_layout* layout() const {
+            return layout_.get();
+        }
+
+        // stores the slots in another layout; instances without a slot in it are
+        // kept alive until the scope ends
+        inline void relayout(std::shared_ptr<const scope_layout> layout, std::vector<std::shared_ptr<void>> slots) {
+            for (auto& value : slots_) {
+                if (value) {
+                    retired_.push_back(std::move(value));
+                }
+            }
+
+            layout_ = std::move(layout);
+            slots_ = std::move(slots);
+        }
+
+    private:
+        std::shared_ptr<const scope_layout> layout_;
+        std::vector<std::shared_ptr<void>> slots_;
+        std::vector<std::shared_ptr<void>> retired_;
+    };
+
+    /*
+        </service table>
+    */
+
+    /*
+        <resolution tape>
+
+        Resolving a root type is done in two phases:
+            * the dependency graph is walked once with an explicit stack and flattened
+              into a post-order tape of instructions; cycles are detected during the walk,
+            * the tape is executed by a loop over a value stack.
+
+        Native stack usage doesn't depend on the depth of the graph, and execution
+        touches only the service table and the scope - no lookups, no virtual calls.
+
+        load_singleton   entry     - pushes the singleton instance
+        load_expiring    entry     - pushes the current instance of an expiring service
+        load_scoped      entry, j  - pushes the instance stored in scope and jumps over
+                                     the instruction j, falls through if there is none
+        load_weak        entry, j  - as load_scoped, for the last instance of a weak-cached
+                                     service while it is alive
+        construct        entry, n  - pops n values, calls the factory and pushes the result
+        construct_scoped entry, n  - as construct, and stores the result in scope
+        construct_weak   entry, n  - as construct, and caches the result unless another
+                                     thread did first; then pushes that instance instead
+        construct_root   n         - as construct, using the factory of the root type
+    */
+    enum class tape_opcode : std::uint8_t {
+        load_singleton,
+        load_expiring,
+        load_scoped,
+        load_weak,
+        construct,
+        construct_scoped,
+        construct_weak,
+        construct_root
+    };
+
+    struct tape_instruction {
+        tape_opcode opcode;
+        std::uint32_t operand;
+        const service_entry* entry;
+    };
+
+    struct resolution_tape;
+
+    // compiles the tape of the same root against another tuple, see extensible_tuple::reseal
+    using tape_compiler = resolution_tape(*)(const extensible_tuple&);
+
+    struct resolution_tape {
+        std::vector<tape_instruction> code;
+        factory_function root = nullptr;
+        tape_compiler compile = nullptr;
+        // root type, for diagnostics
+        const char* name = nullptr;
+        // implementation type constructed by each instruction, null for the others; for diagnostics
+        std::vector<const char*> names;
+        std::size_t max_depth = 0;
+        // services the tape reads, sorted
+        std::vector<service_key> services;
+    };
+
+    // counter of the tapes run without the lock of the tape cache, see the .ipp
+    struct tape_pins;
+
+    // tapes are compiled lazily from const resolve calls, hence the lock;
+    // it is recursive, as materializing a module may construct its singletons
+    class tape_cache {
+    public:
+        tape_cache();
+        tape_cache(tape_cache&& other) noexcept;
+        tape_cache& operator=(tape_cache&& other) noexcept;
+
+        // Refreshes of expiring services run their tape without the lock; they
+        // pin it while holding the lock, so that a registration holding it can
+        // wait for them before dropping tapes or moving entries.
+        void pin();
+        void unpin();
+
+        // called with mutex held
+        void wait_unpinned();
+
+        std::recursive_mutex mutex;
+        std::map<service_key, resolution_tape> tapes;
+        // service -> roots of the tapes (cached or sealed) that read it, sorted
+        std::map<service_key, std::vector<service_key>> dependents;
+
+    private:
+        std::shared_ptr<tape_pins> pins_;
+    };
+
+    /*
+        </resolution tape>
+    */
+
+    /*
+        <perfect hash>
+
+        Minimal perfect hash over service keys, built by hash-and-displace: keys are
+        split into buckets by their hash code, and the buckets, largest first, are
+        given a displacement that moves all of their keys into free slots.
+        Looking a key up is a single probe and a comparison.
+
+        Building fails if two keys share a hash code; the map it was meant to
+        replace should be used then.
+    */
+    inline std::size_t mix_hash(std::uint64_t hash) {
+        hash ^= hash >> 33;
+        hash *= 0xff51afd7ed558ccdull;
+        hash ^= hash >> 33;
+        return static_cast<std::size_t>(hash);
+    }
+
+    template <typename TValue>
+    class perfect_hash_map {
+    public:
+        inline bool build(const std::vector<std::pair<service_key, TValue>>& items) {
+            clear();
+
+            const std::size_t count = items.size();
+
+            if (count == 0) {
+                return true;
+            }
+
+            std::vector<std::vector<std::size_t>> buckets(count);
+
+            for (std::size_t item = 0; item < count; ++item) {
+                buckets[mix_hash(items[item].first.hash_code()) % count].push_back(item);
+            }
+
+            std::vector<std::size_t> order(count);
+
+            for (std::size_t bucket = 0; bucket < count; ++bucket) {
+                order[bucket] = bucket;
+            }
+
+            std::sort(order.begin(), order.end(), [&](std::size_t left, std::size_t right) {
+                return buckets[left].size() > buckets[right].size();
+            });
+
+            std::vector<std::size_t> displacements(count, 0);
+            std::vector<slot> slots(count);
+            std::vector<bool> taken(count, false);
+            std::vector<std::size_t> placed;
+
+            for (std::size_t bucket : order) {
+                if (buckets[bucket].empty()) {
+                    break;
+                }
+
+                bool fits = false;
+
+                for (std::size_t displacement = 1; !fits && displacement <= max_displacement(count); ++displacement) {
+                    placed.clear();
+                    fits = true;
+
+                    for (std::size_t item : buckets[bucket]) {
+                        const std::size_t target = index_of(items[item].first.hash_code(), displacement, count);
+
+                        if (taken[target] || std::find(placed.begin(), placed.end(), target) != placed.end()) {
+                            fits = false;
+                            break;
+                        }
+
+                        placed.push_back(target);
+                    }
+
+                    if (fits) {
+                        displacements[bucket] = displacement;
+                    }
+                }
+
+                // keys sharing a hash code never fit
+                if (!fits) {
+                    return false;
+                }
+
+                for (std::size_t i = 0; i < placed.size(); ++i) {
+                    const auto& item = items[buckets[bucket][i]];
+                    taken[placed[i]] = true;
+                    slots[placed[i]] = { item.first.hash_code(), item.first, item.second };
+                }
+            }
+
+            displacements_ = std::move(displacements);
+            slots_ = std::move(slots);
+            return true;
+        }
+
+        inline const TValue* find(const service_key& key) const {
+            const slot* candidate = probe(key);
+            return candidate != nullptr ? &candidate->value : nullptr;
+        }
+
+        inline void erase(const service_key& key) {
+            if (slot* removed = probe(key)) {
+                *removed = slot();
+            }
+        }
+
+        inline void clear() {
+            displacements_.clear();
+            slots_.clear();
+        }
+
+        inline bool empty() const {
+            return slots_.empty();
+        }
+
+        inline std::size_t bytes() const {
+            return displacements_.capacity() * sizeof(std::size_t) + slots_.capacity() * sizeof(slot);
+        }
+
+    private:
+        struct slot {
+            std::size_t hash = 0;
+            service_key key;
+            TValue value{};
+        };
+
+        inline const slot* probe(const service_key& key) const {
+            const std::size_t index = slot_of(key);
+            return index != slots_.size() ? &slots_[index] : nullptr;
+        }
+
+        inline slot* probe(const service_key& key) {
+            const std::size_t index = slot_of(key);
+            return index != slots_.size() ? &slots_[index] : nullptr;
+        }
+
+        // index of the slot holding key, slots_.size() if there is none
+        inline std::size_t slot_of(const service_key& key) const {
+            const std::size_t count = slots_.size();
+
+            if (count == 0) {
+                return count;
+            }
+
+            const std::size_t hash = key.hash_code();
+            const std::size_t index = index_of(hash, displacements_[mix_hash(hash) % count], count);
+
+            return slots_[index].hash == hash && slots_[index].key == key ? index : count;
+        }
+
+        static inline std::size_t index_of(std::size_t hash, std::size_t displacement, std::size_t count) {
+            return mix_hash(hash ^ (displacement * 0x9e3779b97f4a7c15ull)) % count;
+        }
+
+        static inline std::size_t max_displacement(std::size_t count) {
+            return 64 * count + 1024;
+        }
+
+        std::vector<std::size_t> displacements_;
+        std::vector<slot> slots_;
+    };
+
+    /*
+        </perfect hash>
+    */
+
+#ifdef JASZYK_DEPENDENCY_RESOLVER_SEPARATE_COMPILATION
+    extern template class perfect_hash_map<const resolution_tape*>;
+#endif
+
+    /*
+        <lazy modules>
+
+        A module is a group of registrations declared together with the services it
+        provides. Nothing runs when it is added: the first time one of the provided
+        services is missing while compiling a tape, the module's registrations are
+        executed (singletons constructed, service table extended) and the lookup
+        is retried.
+    */
+    using module_function = std::function<void(extensible_tuple&)>;
+
+    // name - implementation type (the root type for roots), instance - the new instance, type-erased
+    using service_observer = std::function<void(const char* name, const std::shared_ptr<void>& instance)>;
+
+    struct lazy_module {
+        std::vector<service_key> provides;
+        module_function configure;
+    };
+
+    /*
+        </lazy modules>
+    */
+
+    /*
+        What happens when a service is registered again:
+            keep_first - the registration is ignored
+            replace    - the service is rebound; only tapes reading it are recompiled
+            error      - duplicate_registration_exception is thrown
+            append     - the service is rebound and the earlier bindings are kept,
+                         resolve_all returns all of them in registration order
+    */
+    enum class registration_policy {
+        keep_first,
+        replace,
+        error,
+        append
+    };
+    
+    /*
+        <memory statistics>
+
+        Bytes held by a resolver, as reported by dependency_resolver::memory_stats.
+        Sizes of standard containers' nodes and of shared_ptr control blocks are not
+        observable, they are estimated as three pointers and a color for a map node
+        and a vtable pointer with two counters for a control block.
+    */
+    struct memory_statistics {
+        std::size_t services = 0;           // bound services
+        std::size_t entries = 0;            // service table entries, dead ones included
+        std::size_t registry_bytes = 0;     // service table, metadata and lookup maps
+        std::size_t singletons = 0;         // distinct singleton instances
+        std::size_t singleton_bytes = 0;    // instances and their control blocks
+        std::size_t tapes = 0;              // compiled and sealed tapes
+        std::size_t tape_bytes = 0;         // tapes and their dependents index
+        std::size_t scoped_instances = 0;   // instances held by the measured scope
+        std::size_t scope_bytes = 0;        // the measured scope, its slots and instances
+
+        inline std::size_t total_bytes() const {
+            return registry_bytes + singleton_bytes + tape_bytes + scope_bytes;
+        }
+    };
+
+    constexpr std::size_t map_node_overhead() { return 4 * sizeof(void*); }
+
+    constexpr std::size_t control_block_size() { return sizeof(void*) + 2 * sizeof(long); }
+
+    template <typename TKey, typename TValue>
+    inline std::size_t map_bytes(const std::map<TKey, TValue>& map) {
+        return map.size() * (sizeof(typename std::map<TKey, TValue>::value_type) + map_node_overhead());
+    }
+
+    /*
+        </memory statistics>
+    */
+
+    /*
+        <hosted services>
+
+        Singletons with void start() and void stop() members are hosted: they are
+        collected when registered, started by start_hosted_services() and stopped
+        by stop_hosted_services(). A hosted service starts after every hosted
+        service it depends on, directly or through other services; services of
+        the same level don't depend on each other and start concurrently. They
+        stop level by level in reverse order, all within one deadline; once it
+        runs out, the rest go on stopping in order in the background, and the
+        next stop_hosted_services() waits for them.
+
+        Clones share the hosted services, including whether they were started,
+        so each service is started and stopped once, by whichever resolver does
+        it first. A service is dropped with its last binding when it is removed
+        or replaced; the last resolver hosting it stops it if it was started.
+    */
+    template <typename T, typename = void>
+    struct is_hosted_service : std::false_type { };
+
+    template <typename T>
+    struct is_hosted_service<T, typename make_void<decltype(std::declval<T&>().start()), decltype(std::declval<T&>().stop())>::type>
+        : std::true_type { };
+
+    using hosted_function = void(*)(void*);
+
+    template <typename TService>
+    inline void start_service(void* service) {
+        static_cast<TService*>(service)->start();
+    }
+
+    template <typename TService>
+    inline void stop_service(void* service) {
+        static_cast<TService*>(service)->stop();
+    }
+
+    struct hosted_service {
+        std::shared_ptr<void> instance;
+        hosted_function start = nullptr;
+        hosted_function stop = nullptr;
+        dependencies_function dependencies = nullptr;
+        const char* name = nullptr;
+        std::atomic<bool> started{ false };
+    };
+
+    // services of a stop_hosted call still stopping past its deadline, see the .ipp
+    struct hosted_stop;
+
+    /*
+        </hosted services>
+    */
+
+    /*
+        <extensible tuple>
+
+        This class is used to store dependencies in dependency resolver.
+        It allows to store dependencies and resolve them later.
+
+        add_singleton<TInterface, TService>(value) - stores singleton value of type TService as TInterface
+            * singleton value is resolved once and stored in tuple
+
+        add_transient<TInterface, TService>() - stores transient value of type TService as TInterface
+            * transient value is resolved every time it is requested
+
+        add_scoped<TInterface, TService>() - stores scoped value of type TService as TInterface
+            * scoped value is resolved once and stored in scope
+			* if scope is not provided, missing_scope_exception is thrown
+
+        add_expiring<TInterface, TService>(ttl) - stores value of type TService as TInterface for ttl
+            * value is resolved when added and rebuilt when it expires, see expiring services
+
+        add_weak_cached<TInterface, TService>() - stores weak-cached value of type TService as TInterface
+            * value is resolved again only when no one holds the last one, see weak-cached services
+
+        resolve_object<T>([scope]) - resolves object of type T
+			* if object's parameter is not stored in tuple, element_not_found_exception is thrown
+			* if object's dependencies form a cycle, circular_dependency_exception is thrown
+
+        resolve_all<T>([scope]) - resolves every binding of service T, oldest first
+
+        remove<T>() - removes all bindings of service T, tapes reading it are dropped
+
+        compact() - drops entries no longer bound to any service; compiled tapes are
+            kept and retargeted. Runs by itself once dead entries outnumber live ones.
+
+        prepare<T>() - compiles the tape of T ahead of the first resolve
+
+        seal() - freezes compiled tapes, so that resolving them takes no lock
+            * registering a new service keeps all tapes, it isn't read by any of them
+            * rebinding a service (registration_policy::replace) drops only the tapes
+              whose graphs contain it; the others stay sealed
+
+    */
+    class extensible_tuple {
+    public:
+        extensible_tuple();
+
+        extensible_tuple(const extensible_tuple& other) = delete;
+
+        extensible_tuple(extensible_tuple&& other) noexcept;
+
+        extensible_tuple& operator=(const extensible_tuple& other) = delete;
+
+        extensible_tuple& operator=(extensible_tuple&& other) noexcept;
+
+        ~extensible_tuple();
+
+        template <typename TInterface, typename TService>
+        void add_singleton(const std::shared_ptr<TService>& value, dependencies_function dependencies = &no_dependencies);
+
+        template <typename TInterface, typename TService>
+        void add_transient();
+
+        template <typename TInterface, typename TService>
+        void add_scoped();
+
+        template <typename TInterface, typename TService>
+        void add_expiring(std::chrono::steady_clock::duration ttl);
+
+        template <typename TInterface, typename TService>
+        void add_weak_cached();
+
+        template <template <typename...> class TInterface>
+        void add_template(service_lifetime lifetime);
+
+        template <typename TInterface, typename TService>
+        bool close_generic(const service_key& generic);
+
+        // binds a service needed while resolving, bypassing the registration policy
+        template <typename TInterface, typename TService>
+        void bind_implementation(service_lifetime lifetime);
+
+        // wraps the current binding of TInterface, which keeps its lifetime
+        template <typename TInterface, typename TDecorator>
+        void decorate();
+
+        void add_module(std::vector<service_key> provides, module_function configure);
+
+        // observers see every instance the tapes construct, in diagnostic builds only
+        void add_observer(service_observer observer);
+
+        // rethrows the first exception of a start, after stopping the services already started
+        void start_hosted();
+
+        // false if some services didn't stop before the deadline; they go on stopping in order
+        bool stop_hosted(std::chrono::steady_clock::time_point deadline);
+
+        // rethrows the first exception of a rebuild, after rebuilding the others
+        void refresh_expiring() const;
+
+        template <typename T>
+        std::shared_ptr<T> resolve_object() const;
+
+        template <typename T>
+        std::shared_ptr<T> resolve_object(scope_storage& scope) const;
+
+        template <typename T>
+        std::vector<std::shared_ptr<T>> resolve_all(scope_storage* scope) const;
+
+        template <typename T>
+        bool remove();
+
+        void compact();
+
+        template <typename T>
+        void prepare() const;
+
+        void seal();
+
+        // compiles the roots compiled or sealed in source and seals the tuple
+        void reseal(const extensible_tuple& source);
+
+        bool sealed() const;
+
+        template <typename T>
+        bool compiled() const;
+
+        void set_policy(registration_policy policy);
+
+        registration_policy policy() const;
+
+        size_t size() const;
+
+        // scope - scope to measure along with the tuple, may be null
+        memory_statistics memory_stats(const scope_storage* scope) const;
+
+        // copy of the registrations without the excluded keys; singletons are shared
+        extensible_tuple clone(const std::vector<service_key>& excluded) const;
+
+    private:
+        // false if the registration policy kept the existing binding
+        template <typename TInterface>
+        bool add_entry(service_entry entry, service_metadata metadata);
+
+        template <typename TService>
+        void host(const std::shared_ptr<TService>& value, dependencies_function dependencies, std::false_type);
+
+        template <typename TService>
+        void host(const std::shared_ptr<TService>& value, dependencies_function dependencies, std::true_type);
+
+        // hosted_ indexes grouped by start order, see hosted services
+        std::vector<std::vector<std::size_t>> hosted_levels() const;
+
+        std::size_t hosted_level(std::size_t index, std::vector<std::size_t>& levels) const;
+
+        // drops the hosted services no binding refers to anymore, see hosted services
+        void drop_hosted();
+
+        template <typename TInterface, typename TService>
+        static std::shared_ptr<void> build_expiring(const extensible_tuple& tuple);
+
+        // rebuilds a quarter of ttl before expiry, or now if forced; returns when the service is due next
+        std::chrono::steady_clock::time_point refresh(expiring_service& service, bool force) const;
+
+        // hands service to the refresher, starting it unless the tuple is being moved or destroyed
+        void watch(const std::shared_ptr<expiring_service>& service) const;
+
+        // resolves T with its tape pinned, for the refresher, see tape_cache::pin
+        template <typename T>
+        std::shared_ptr<void> execute_pinned() const;
+
+        template <typename TInterface>
+        void insert_entry(service_entry entry, service_metadata metadata);
+
+        // whether the policy keeps the binding of key over a new one; throws if it refuses the new one
+        bool keeps_binding(const service_key& key) const;
+
+        std::size_t push_entry(service_entry entry, service_metadata metadata);
+
+        template <typename TFunction>
+        void for_each_binding(TFunction function) const;
+
+        template <typename TInterface, typename TService>
+        service_entry transient_entry();
+
+        template <typename TInterface, typename TService>
+        service_entry scoped_entry();
+
+        template <typename TService>
+        std::size_t scope_slot_of();
+
+        void invalidate(const service_key& changed);
+
+        // removes the inner bindings of a decorated service, which is rebound or removed
+        void drop_decorations(const service_key& key);
+
+        // number of services in type_index_map_, without the inner bindings of decorators
+        std::size_t services() const;
+
+        bool bind(const dependency& missing);
+
+        bool materialize(const service_key& key);
+
+        void notify_created(const char* name, const std::shared_ptr<void>& instance) const;
+
+        template <typename T>
+        const resolution_tape& tape_for() const;
+
+        template <typename T>
+        const resolution_tape& bindings_tape_for() const;
+
+        template <typename T>
+        static resolution_tape compile_root(const extensible_tuple& tuple);
+
+        template <typename T>
+        static resolution_tape compile_bindings(const extensible_tuple& tuple);
+
+        const resolution_tape* sealed_tape(const service_key& root) const;
+
+        const resolution_tape& cache_tape(const service_key& root, resolution_tape tape) const;
+
+        // bindings - entries to push instead of looking up root_dependencies, root is not constructed
+        resolution_tape compile_tape(const std::vector<dependency>& root_dependencies, factory_function root,
+            const std::vector<std::size_t>* bindings = nullptr) const;
+
+        std::shared_ptr<void> execute_tape(const resolution_tape& tape, scope_storage* scope) const;
+
+        void run_tape(const resolution_tape& tape, scope_storage* scope, std::vector<std::shared_ptr<void>>& values) const;
+
+        // moves the instances of a scope filled by another version to the slots of this one
+        void adopt_scope(scope_storage& scope) const;
+
+        // refers to this tuple; moved first, which pauses its thread before the rest moves
+        mutable refresher_slot refresher_;
+        service_table entries_;
+        std::vector<service_metadata> metadata_;
+        std::map<service_key, std::size_t> type_index_map_;
+        // earlier bindings of services registered with registration_policy::append
+        std::map<service_key, std::vector<std::size_t>> appended_;
+        std::size_t dead_ = 0;
+        std::map<type_id, std::size_t> scope_slots_;
+        std::shared_ptr<const scope_layout> scope_layout_;
+        std::map<type_id, service_lifetime> open_generics_;
+        // keys of the inner bindings of a decorated service, innermost first
+        std::map<service_key, std::vector<service_key>> decorations_;
+        std::vector<lazy_module> modules_;
+        std::map<service_key, std::size_t> pending_modules_;
+        int materializing_ = 0;
+        std::vector<service_observer> observers_;
+        std::vector<std::shared_ptr<hosted_service>> hosted_;
+        std::shared_ptr<hosted_stop> stopping_;
+        registration_policy policy_ = registration_policy::keep_first;
+        std::map<service_key, resolution_tape> sealed_tapes_;
+        // sealed_tapes_ by root; empty if root keys collide
+        perfect_hash_map<const resolution_tape*> sealed_index_;
+        bool sealed_ = false;
+        mutable tape_cache tapes_;
+    };
+    /*==========================*/
+
+
+
+    template <typename TInterface, typename TService>
+    inline void extensible_tuple::add_singleton(const std::shared_ptr<TService>& value, dependencies_function dependencies) {
+        const bool added = add_entry<TInterface>(
+            service_entry::singleton(std::shared_ptr<TInterface>(value)),
+            { dependencies, sizeof(TService), typeid(TService).name() });
+
+        if (added) {
+            host(value, dependencies, is_hosted_service<TService>{});
+        }
+    }
+
+    template <typename TService>
+    inline void extensible_tuple::host(const std::shared_ptr<TService>&, dependencies_function, std::false_type) { }
+
+    template <typename TService>
+    inline void extensible_tuple::host(const std::shared_ptr<TService>& value, dependencies_function dependencies, std::true_type) {
+        // registered once more under another interface
+        for (const auto& service : hosted_) {
+            if (!service->instance.owner_before(value) && !value.owner_before(service->instance)) {
+                return;
+            }
+        }
+
+        auto service = std::make_shared<hosted_service>();
+        service->instance = value;
+        service->start = &start_service<TService>;
+        service->stop = &stop_service<TService>;
+        service->dependencies = dependencies;
+        service->name = typeid(TService).name();
+        hosted_.push_back(std::move(service));
+    }
+
+    template <typename TInterface, typename TService>
+    inline void extensible_tuple::add_transient() {
+        add_entry<TInterface>(transient_entry<TInterface, TService>(), { &constructor_traits<TService>::dependencies, 0, typeid(TService).name() });
+    }
+
+    template <typename TInterface, typename TService>
+    inline void extensible_tuple::add_scoped() {
+        add_entry<TInterface>(scoped_entry<TInterface, TService>(), { &constructor_traits<TService>::dependencies, 0, typeid(TService).name() });
+    }
+
+    template <typename TInterface, typename TService>
+    inline void extensible_tuple::add_expiring(std::chrono::steady_clock::duration ttl) {
+        // a binding the policy keeps or refuses isn't built for nothing
+        if (keeps_binding(key_of<TInterface>())) {
+            return;
+        }
+
+        auto service = std::make_shared<expiring_service>();
+        service->ttl = ttl;
+        service->build = &build_expiring<TInterface, TService>;
+        service->instances[0] = service->build(*this);
+        service->expires = (std::chrono::steady_clock::now() + ttl).time_since_epoch().count();
+
+        const bool added = add_entry<TInterface>(service_entry::expiring(service),
+            { &constructor_traits<TService>::dependencies, sizeof(TService), typeid(TService).name() });
+
+        if (added) {
+            watch(service);
+        }
+    }
+
+    template <typename TInterface, typename TService>
+    inline void extensible_tuple::add_weak_cached() {
+        add_entry<TInterface>(service_entry::weak_cached(&make_service<TInterface, TService>),
+            { &constructor_traits<TService>::dependencies, 0, typeid(TService).name() });
+    }
+
+    template <typename TInterface, typename TService>
+    inline std::shared_ptr<void> extensible_tuple::build_expiring(const extensible_tuple& tuple) {
+        return std::shared_ptr<TInterface>(std::static_pointer_cast<TService>(tuple.execute_pinned<TService>()));
+    }
+
+    template <typename T>
+    inline std::shared_ptr<void> extensible_tuple::execute_pinned() const {
+        std::unique_lock<std::recursive_mutex> lock(tapes_.mutex);
+        const resolution_tape& tape = tape_for<T>();
+        tapes_.pin();
+        lock.unlock();
+
+        struct pin_guard {
+            tape_cache& tapes;
+
+            ~pin_guard() {
+                tapes.unpin();
+            }
+        } guard{ tapes_ };
+
+        return execute_tape(tape, nullptr);
+    }
+
+    template <template <typename...> class TInterface>
+    inline void extensible_tuple::add_template(service_lifetime lifetime) {
+        std::lock_guard<std::recursive_mutex> lock(tapes_.mutex);
+        open_generics_[type_id_of<template_key<TInterface>>()] = lifetime;
+    }
+
+    // Called while compiling a tape: closed services are only added, so tapes
+    // compiled earlier stay valid and are not invalidated.
+    template <typename TInterface, typename TService>
+    inline bool extensible_tuple::close_generic(const service_key& generic) {
+        auto it = open_generics_.find(generic);
+
+        if (it == open_generics_.end()) {
+            return false;
+        }
+
+        bind_implementation<TInterface, TService>(it->second);
+        return true;
+    }
+
+    template <typename TInterface, typename TService>
+    inline void extensible_tuple::bind_implementation(service_lifetime lifetime) {
+        switch (lifetime) {
+        case service_lifetime::singleton: {
+            auto tape = compile_tape(constructor_traits<TService>::dependencies(), &constructor_traits<TService>::construct_erased);
+            auto value = std::static_pointer_cast<TService>(execute_tape(tape, nullptr));
+            insert_entry<TInterface>(service_entry::singleton(std::shared_ptr<TInterface>(value)), { &constructor_traits<TService>::dependencies, sizeof(TService), typeid(TService).name() });
+            host(value, &constructor_traits<TService>::dependencies, is_hosted_service<TService>{});
+            break;
+        }
+        case service_lifetime::transient:
+            insert_entry<TInterface>(transient_entry<TInterface, TService>(), { &constructor_traits<TService>::dependencies, 0, typeid(TService).name() });
+            break;
+        case service_lifetime::scoped:
+            insert_entry<TInterface>(scoped_entry<TInterface, TService>(), { &constructor_traits<TService>::dependencies, 0, typeid(TService).name() });
+            break;
+        // add_*_template and the bundle markers bind none of these
+        case service_lifetime::expiring:
+        case service_lifetime::weak_cached:
+            throw std::logic_error("Open generics and dependency bundles are singletons, transients or scoped services.");
+        }
+    }
+
+    template <typename TInterface, typename TDecorator>
+    inline void extensible_tuple::decorate() {
+        std::lock_guard<std::recursive_mutex> lock(tapes_.mutex);
+        const service_key key = key_of<TInterface>();
+
+        if (type_index_map_.count(key) == 0) {
+            materialize(key);
+        }
+
+        auto it = type_index_map_.find(key);
+
+        if (it == type_index_map_.end()) {
+            throw element_not_found_exception();
+        }
+
+        // the inner binding is kept under a key of the decorator type, so a decorator is applied once
+        const service_key inner_key = key_of<decorated<TInterface, TDecorator>>();
+        std::vector<service_key>& layers = decorations_[key];
+
+        if (std::find(layers.begin(), layers.end(), inner_key) != layers.end()) {
+            throw duplicate_decorator_exception(typeid(TDecorator).name());
+        }
+
+        using traits = decorator_traits<TInterface, TDecorator>;
+        const service_metadata metadata{ &traits::dependencies, 0, typeid(TDecorator).name() };
+        const std::size_t inner = it->second;
+        const service_lifetime lifetime = entries_[inner].lifetime();
+
+        layers.push_back(inner_key);
+        type_index_map_[inner_key] = inner;
+
+        switch (lifetime) {
+        case service_lifetime::singleton: {
+            auto tape = compile_tape(traits::dependencies(), &constructor_traits<TDecorator>::construct_erased);
+            auto value = std::static_pointer_cast<TDecorator>(execute_tape(tape, nullptr));
+            it = type_index_map_.find(key);
+            it->second = push_entry(service_entry::singleton(std::shared_ptr<TInterface>(value)),
+                { &traits::dependencies, sizeof(TDecorator), metadata.name });
+            host(value, &traits::dependencies, is_hosted_service<TDecorator>{});
+            break;
+        }
+        // expiring and weak-cached services are wrapped anew on every resolve, around their current instance
+        case service_lifetime::transient:
+        case service_lifetime::expiring:
+        case service_lifetime::weak_cached:
+            it->second = push_entry(transient_entry<TInterface, TDecorator>(), metadata);
+            break;
+        case service_lifetime::scoped:
+            it->second = push_entry(scoped_entry<TInterface, TDecorator>(), metadata);
+            break;
+        }
+
+        invalidate(key);
+    }
+
+    template <typename T>
+    inline std::shared_ptr<T> extensible_tuple::resolve_object() const {
+        return std::static_pointer_cast<T>(execute_tape(tape_for<T>(), nullptr));
+    }
+
+    template <typename T>
+    inline std::shared_ptr<T> extensible_tuple::resolve_object(scope_storage& scope) const {
+        return std::static_pointer_cast<T>(execute_tape(tape_for<T>(), &scope));
+    }
+
+    template <typename T>
+    inline std::vector<std::shared_ptr<T>> extensible_tuple::resolve_all(scope_storage* scope) const {
+        std::vector<std::shared_ptr<void>> values;
+        const resolution_tape& tape = bindings_tape_for<T>();
+
+        values.reserve(tape.max_depth);
+        run_tape(tape, scope, values);
+
+        std::vector<std::shared_ptr<T>> services;
+        services.reserve(values.size());
+
+        for (auto& value : values) {
+            services.push_back(std::static_pointer_cast<T>(std::move(value)));
+        }
+
+        return services;
+    }
+
+    template <typename T>
+    inline bool extensible_tuple::remove() {
+        std::lock_guard<std::recursive_mutex> lock(tapes_.mutex);
+        const service_key key = key_of<T>();
+        pending_modules_.erase(key);
+
+        auto it = type_index_map_.find(key);
+
+        if (it == type_index_map_.end()) {
+            return false;
+        }
+
+        type_index_map_.erase(it);
+        ++dead_;
+        drop_decorations(key);
+
+        auto appended = appended_.find(key);
+
+        if (appended != appended_.end()) {
+            dead_ += appended->second.size();
+            appended_.erase(appended);
+        }
+
+        invalidate(key);
+        drop_hosted();
+
+        if (dead_ > entries_.size() - dead_) {
+            compact();
+        }
+
+        return true;
+    }
+
+    template <typename T>
+    inline void extensible_tuple::prepare() const {
+        tape_for<T>();
+    }
+
+    template <typename T>
+    inline bool extensible_tuple::compiled() const {
+        std::lock_guard<std::recursive_mutex> lock(tapes_.mutex);
+        return sealed_tapes_.count(key_of<T>()) != 0 || tapes_.tapes.count(key_of<T>()) != 0;
+    }
+
+    // registrations of a module run while a tape is compiled and only add services,
+    // tapes being executed must not be dropped under them
+    template <typename TInterface>
+    inline bool extensible_tuple::add_entry(service_entry entry, service_metadata metadata) {
+        std::lock_guard<std::recursive_mutex> lock(tapes_.mutex);
+        auto it = type_index_map_.find(key_of<TInterface>());
+
+        if (it == type_index_map_.end()) {
+            insert_entry<TInterface>(std::move(entry), metadata);
+            return true;
+        }
+
+        if (keeps_binding(it->first)) {
+            return false;
+        }
+
+        if (policy_ == registration_policy::replace) {
+            ++dead_;
+            drop_decorations(it->first);
+        }
+        else {
+            appended_[it->first].push_back(it->second);
+        }
+
+        it->second = push_entry(std::move(entry), metadata);
+        invalidate(it->first);
+
+        if (policy_ == registration_policy::replace) {
+            drop_hosted();
+        }
+
+        if (dead_ > entries_.size() - dead_) {
+            compact();
+        }
+
+        return true;
+    }
+
+    template <typename TInterface>
+    inline void extensible_tuple::insert_entry(service_entry entry, service_metadata metadata) {
+        std::lock_guard<std::recursive_mutex> lock(tapes_.mutex);
+        type_index_map_.insert({ key_of<TInterface>(), push_entry(std::move(entry), metadata) });
+    }
+
+    template <typename TFunction>
+    inline void extensible_tuple::for_each_binding(TFunction function) const {
+        for (const auto& service : type_index_map_) {
+            function(service.second);
+        }
+
+        for (const auto& bindings : appended_) {
+            for (std::size_t index : bindings.second) {
+                function(index);
+            }
+        }
+    }
+
+    template <typename TInterface, typename TService>
+    inline service_entry extensible_tuple::transient_entry() {
+        return service_entry::transient(&make_service<TInterface, TService>);
+    }
+
+    template <typename TInterface, typename TService>
+    inline service_entry extensible_tuple::scoped_entry() {
+        return service_entry::scoped(&constructor_traits<TService>::construct_erased, &cast_service<TInterface, TService>, scope_slot_of<TService>());
+    }
+
+    template <typename TService>
+    inline std::size_t extensible_tuple::scope_slot_of() {
+        auto slot = scope_slots_.insert({ type_id_of<TService>(), scope_slots_.size() });
+
+        if (slot.second) {
+            auto layout = scope_layout_ ? std::make_shared<scope_layout>(*scope_layout_) : std::make_shared<scope_layout>();
+            layout->types.push_back(type_id_of<TService>());
+            layout->sizes.push_back(sizeof(TService));
+            scope_layout_ = std::move(layout);
+        }
+
+        return slot.first->second;
+    }
+
+    template <typename T>
+    inline const resolution_tape& extensible_tuple::tape_for() const {
+        if (sealed_) {
+            if (const resolution_tape* tape = sealed_tape(key_of<T>())) {
+                return *tape;
+            }
+        }
+
+        std::lock_guard<std::recursive_mutex> lock(tapes_.mutex);
+
+        auto it = tapes_.tapes.find(key_of<T>());
+
+        if (it != tapes_.tapes.end()) {
+            return it->second;
+        }
+
+        return cache_tape(key_of<T>(), compile_root<T>(*this));
+    }
+
+    template <typename T>
+    inline resolution_tape extensible_tuple::compile_root(const extensible_tuple& tuple) {
+        resolution_tape tape = tuple.compile_tape(constructor_traits<T>::dependencies(), &constructor_traits<T>::construct_erased);
+        tape.compile = &compile_root<T>;
+        tape.name = typeid(T).name();
+
+        return tape;
+    }
+
+    // cached under the key of std::vector<std::shared_ptr<T>>, so that it doesn't clash with the tape of T
+    template <typename T>
+    inline const resolution_tape& extensible_tuple::bindings_tape_for() const {
+        const service_key root = type_id_of<std::vector<std::shared_ptr<T>>>();
+
+        if (sealed_) {
+            if (const resolution_tape* tape = sealed_tape(root)) {
+                return *tape;
+            }
+        }
+
+        std::lock_guard<std::recursive_mutex> lock(tapes_.mutex);
+
+        auto it = tapes_.tapes.find(root);
+
+        if (it != tapes_.tapes.end()) {
+            return it->second;
+        }
+
+        return cache_tape(root, compile_bindings<T>(*this));
+    }
+
+    template <typename T>
+    inline resolution_tape extensible_tuple::compile_bindings(const extensible_tuple& tuple) {
+        const dependency service = dependency_of<T>();
+
+        if (tuple.type_index_map_.count(service.key) == 0) {
+            const_cast<extensible_tuple&>(tuple).bind(service);
+        }
+
+        std::vector<std::size_t> bindings;
+        auto appended = tuple.appended_.find(service.key);
+
+        if (appended != tuple.appended_.end()) {
+            bindings = appended->second;
+        }
+
+        auto primary = tuple.type_index_map_.find(service.key);
+
+        if (primary != tuple.type_index_map_.end()) {
+            bindings.push_back(primary->second);
+        }
+
+        resolution_tape tape = tuple.compile_tape(no_dependencies(), nullptr, &bindings);
+        tape.compile = &compile_bindings<T>;
+        // rebinding T drops the tape even when T has no bindings yet
+        tape.services.insert(std::lower_bound(tape.services.begin(), tape.services.end(), service.key), service.key);
+        tape.services.erase(std::unique(tape.services.begin(), tape.services.end()), tape.services.end());
+
+        return tape;
+    }
+
+    /*
+        </extensible tuple>
+    */
+
+    /*
+        <singleton binding>
+
+        Returned from dependency_resolver::add_singleton, exposes the single instance
+        under additional interfaces:
+
+            resolver.add_singleton<Service>().as<IFirst, ISecond>();
+
+        Every interface gets its own entry holding the instance already cast to that
+        interface, so the service is constructed once and resolving any of them is
+        a plain load.
+    */
+    template <typename TService>
+    class singleton_binding {
+    public:
+        // dependencies - of the constructor the resolver built the instance with, if it did
+        inline singleton_binding(extensible_tuple& tuple, std::shared_ptr<TService> instance, dependencies_function dependencies)
+            : tuple_(tuple), instance_(std::move(instance)), dependencies_(dependencies) { }
+
+        template <typename... TInterfaces>
+        inline singleton_binding& as() {
+            int expand[] = { 0, (add<TInterfaces>(), 0)... };
+            (void)expand;
+            return *this;
+        }
+
+        inline const std::shared_ptr<TService>& instance() const {
+            return instance_;
+        }
+
+    private:
+        template <typename TInterface>
+        inline void add() {
+            static_assert(std::is_convertible<TService*, TInterface*>::value, "Service is not convertible to the interface.");
+            tuple_.add_singleton<TInterface, TService>(instance_, dependencies_);
+        }
+
+        extensible_tuple& tuple_;
+        std::shared_ptr<TService> instance_;
+        dependencies_function dependencies_;
+    };
+
+    /*
+        </singleton binding>
+    */
+
+    /*
+        <open generics>
+
+        Implementation of an open generic interface is chosen at compile time,
+        where the closed interface is needed, by JASZYK_OPEN_GENERIC:
+
+            JASZYK_OPEN_GENERIC(IRepository, Repository)
+
+            resolver.add_scoped_template<IRepository, Repository>();
+
+        The registration stores only the lifetime of the family. A dependency on
+        IRepository<User> that isn't registered is closed on first resolve, added
+        to the service table as IRepository<User> -> Repository<User> and resolved
+        as any other service from then on.
+    */
+    template <template <typename...> class TInterface>
+    struct open_generic { };
+
+    template <template <typename...> class TInterface, typename... TArgs>
+    struct dependency_binder<TInterface<TArgs...>, typename make_void<typename open_generic<TInterface>::template implementation<TArgs...>>::type> {
+        static bool bind(extensible_tuple& tuple) {
+            using implementation = typename open_generic<TInterface>::template implementation<TArgs...>;
+            return tuple.close_generic<TInterface<TArgs...>, implementation>(type_id_of<template_key<TInterface>>());
+        }
+
+        static constexpr binder_function get() {
+            return &bind;
+        }
+    };
+
+    /*
+        </open generics>
+    */
+
+    /*
+        <dependency bundles>
+
+        A bundle is an aggregate of std::shared_ptr handed to a service as one
+        parameter, so that a service with many dependencies takes one pointer and
+        one reference count instead of one per dependency:
+
+            struct HandlerServices {
+                using dependency_bundle = dependency_resolver::scoped_bundle;
+
+                std::shared_ptr<ILogger> logger;
+                std::shared_ptr<IRepository> repository;
+            };
+
+            Handler(std::shared_ptr<HandlerServices> services);
+
+        Bundles need no registration. The first service depending on one binds
+        it with the lifetime of its marker; a scoped bundle is filled once per
+        scope by its own tape and shared by every consumer in the scope.
+    */
+    template <service_lifetime Lifetime>
+    struct bundle {
+        static constexpr service_lifetime lifetime = Lifetime;
+    };
+
+    template <typename TBundle>
+    struct dependency_binder<TBundle, typename make_void<typename TBundle::dependency_bundle>::type> {
+        static_assert(constructor_traits<TBundle>::aggregate, "A dependency bundle must be an aggregate of std::shared_ptr.");
+        static_assert(TBundle::dependency_bundle::lifetime == service_lifetime::singleton || TBundle::dependency_bundle::lifetime == service_lifetime::transient
+            || TBundle::dependency_bundle::lifetime == service_lifetime::scoped, "A dependency bundle is a singleton, transient or scoped service.");
+
+        static bool bind(extensible_tuple& tuple) {
+            tuple.bind_implementation<TBundle, TBundle>(TBundle::dependency_bundle::lifetime);
+            return true;
+        }
+
+        static constexpr binder_function get() {
+            return &bind;
+        }
+    };
+
+    /*
+        </dependency bundles>
+    */
+
+    /*
+        <registration api>
+
+        Registration methods shared by dependency_resolver and the registrar handed
+        to lazy modules; TDerived provides tuple().
+    */
+    template <typename TDerived>
+    class registration_api {
+    public:
+        template <typename TInterface, typename TService>
+        inline singleton_binding<TService> add_singleton(const TService& value) {
+            static_assert(!std::is_abstract<TService>::value, "Cannot register abstract type.");
+            return bind_singleton<TInterface>(::jaszyk::dependency_resolver_impl::utility::create_service<TService>(std::false_type{}, value));
+        }
+
+        template <typename TService>
+        inline singleton_binding<TService> add_singleton(const TService& value) {
+			static_assert(!std::is_abstract<TService>::value, "Cannot register abstract type.");
+			return bind_singleton<TService>(::jaszyk::dependency_resolver_impl::utility::create_service<TService>(std::false_type{}, value));
+		}
+
+        template <typename TService>
+        inline singleton_binding<TService> add_singleton() {
+            static_assert(!std::is_abstract<TService>::value, "Cannot register abstract type.");
+            return bind_singleton<TService>(tuple().template resolve_object<TService>(),
+                &::jaszyk::dependency_resolver_impl::utility::constructor_traits<TService>::dependencies);
+        }
+
+        template <typename TInterface, typename TService>
+        inline singleton_binding<TService> add_singleton() {
+            static_assert(!std::is_abstract<TService>::value, "Cannot register abstract type.");
+            return bind_singleton<TInterface>(tuple().template resolve_object<TService>(),
+                &::jaszyk::dependency_resolver_impl::utility::constructor_traits<TService>::dependencies);
+        }
+
+        template <typename TService>
+        inline void add_transient() {
+            static_assert(!std::is_abstract<TService>::value, "Cannot register abstract type.");
+            tuple().template add_transient<TService, TService>();
+        }
+
+        template <typename TInterface, typename TService>
+        inline void add_transient() {
+            static_assert(!std::is_abstract<TService>::value, "Cannot register abstract type.");
+            tuple().template add_transient<TInterface, TService>();
+        }
+
+        template <typename TService>
+        inline void add_scoped() {
+            static_assert(!std::is_abstract<TService>::value, "Cannot register abstract type.");
+            tuple().template add_scoped<TService, TService>();
+        }
+
+        template <typename TInterface, typename TService>
+        inline void add_scoped() {
+            static_assert(!std::is_abstract<TService>::value, "Cannot register abstract type.");
+			tuple().template add_scoped<TInterface, TService>();
+		}
+
+        // built now and rebuilt when ttl is over, see expiring services
+        template <typename TService, typename TRep, typename TPeriod>
+        inline void add_expiring(std::chrono::duration<TRep, TPeriod> ttl) {
+            add_expiring<TService, TService>(ttl);
+        }
+
+        template <typename TInterface, typename TService, typename TRep, typename TPeriod>
+        inline void add_expiring(std::chrono::duration<TRep, TPeriod> ttl) {
+            static_assert(!std::is_abstract<TService>::value, "Cannot register abstract type.");
+            tuple().template add_expiring<TInterface, TService>(std::chrono::duration_cast<std::chrono::steady_clock::duration>(ttl));
+        }
+
+        // a transient that is shared while alive, see weak-cached services
+        template <typename TService>
+        inline void add_weak_cached() {
+            static_assert(!std::is_abstract<TService>::value, "Cannot register abstract type.");
+            tuple().template add_weak_cached<TService, TService>();
+        }
+
+        template <typename TInterface, typename TService>
+        inline void add_weak_cached() {
+            static_assert(!std::is_abstract<TService>::value, "Cannot register abstract type.");
+            tuple().template add_weak_cached<TInterface, TService>();
+        }
+
+        // TDecorator takes the wrapped std::shared_ptr<TInterface>; the last decorator added is the outermost
+        template <typename TInterface, typename TDecorator>
+        inline void decorate() {
+            static_assert(!std::is_abstract<TDecorator>::value, "Cannot register abstract type.");
+            static_assert(std::is_base_of<TInterface, TDecorator>::value, "A decorator must implement the decorated interface.");
+            static_assert(::jaszyk::dependency_resolver_impl::utility::takes_argument<std::shared_ptr<TInterface>,
+                typename ::jaszyk::dependency_resolver_impl::utility::constructor_traits<TDecorator>::arguments>::value,
+                "A decorator must take the decorated interface.");
+            tuple().template decorate<TInterface, TDecorator>();
+        }
+
+        template <template <typename...> class TInterface, template <typename...> class TService = TInterface>
+        inline void add_singleton_template() {
+            add_template<TInterface, TService>(service_lifetime::singleton);
+        }
+
+        template <template <typename...> class TInterface, template <typename...> class TService = TInterface>
+        inline void add_transient_template() {
+            add_template<TInterface, TService>(service_lifetime::transient);
+        }
+
+        template <template <typename...> class TInterface, template <typename...> class TService = TInterface>
+        inline void add_scoped_template() {
+            add_template<TInterface, TService>(service_lifetime::scoped);
+        }
+
+    private:
+        template <template <typename...> class TInterface, template <typename...> class TService>
+        inline void add_template(service_lifetime lifetime) {
+            using binding = open_generic<TInterface>;
+            using implementation = template_key<TService>;
+            static_assert(std::is_same<typename binding::implementation_key, implementation>::value,
+                "Open generic binding of the interface (JASZYK_OPEN_GENERIC) doesn't name the service.");
+            tuple().template add_template<TInterface>(lifetime);
+        }
+
+        template <typename TInterface, typename TService>
+        inline singleton_binding<TService> bind_singleton(std::shared_ptr<TService> instance,
+            ::jaszyk::dependency_resolver_impl::utility::dependencies_function dependencies = &::jaszyk::dependency_resolver_impl::utility::no_dependencies) {
+            tuple().template add_singleton<TInterface, TService>(instance, dependencies);
+            return singleton_binding<TService>(tuple(), std::move(instance), dependencies);
+        }
+
+        inline extensible_tuple& tuple() {
+            return static_cast<TDerived&>(*this).tuple();
+        }
+    };
+
+    /*
+        </registration api>
+    */
+
+    class resolver_scope : public scope_storage { };
+
+    // Holds dependency_resolver::global_scope. C++14 has no inline variables, but a
+    // static member of a class template may be defined in a header included by
+    // any number of translation units.
+    template <typename TScope>
+    struct resolver_statics {
+        static TScope global_scope;
+    };
+
+    template <typename TScope>
+    TScope resolver_statics<TScope>::global_scope;
+
+} // namespace utility
+} // namespace dependency_resolver_impl
+
+    // registration handle given to lazy modules and plugins
+    class dependency_registrar : public ::jaszyk::dependency_resolver_impl::utility::registration_api<dependency_registrar> {
+        friend class ::jaszyk::dependency_resolver_impl::utility::registration_api<dependency_registrar>;
+        using extensible_tuple = ::jaszyk::dependency_resolver_impl::utility::extensible_tuple;
+    public:
+        inline explicit dependency_registrar(extensible_tuple& tuple)
+            : tuple_(tuple) { }
+
+    private:
+        inline extensible_tuple& tuple() {
+            return tuple_;
+        }
+
+        extensible_tuple& tuple_;
+    };
+
+    class dependency_resolver
+        : public ::jaszyk::dependency_resolver_impl::utility::registration_api<dependency_resolver>
+        , public ::jaszyk::dependency_resolver_impl::utility::resolver_statics<::jaszyk::dependency_resolver_impl::utility::resolver_scope> {
+        using extensible_tuple = ::jaszyk::dependency_resolver_impl::utility::extensible_tuple;
+        using scope_storage = ::jaszyk::dependency_resolver_impl::utility::scope_storage;
+        using scope_type = ::jaszyk::dependency_resolver_impl::utility::resolver_scope;
+    public:
+        using scope = scope_type;
+
+        struct temporary_scope {};
+
+        using dependency_not_found_exception = ::jaszyk::dependency_resolver_impl::utility::element_not_found_exception;
+
+        using missing_scope_exception = ::jaszyk::dependency_resolver_impl::utility::missing_scope_exception;
+
+        using circular_dependency_exception = ::jaszyk::dependency_resolver_impl::utility::circular_dependency_exception;
+
+        using duplicate_registration_exception = ::jaszyk::dependency_resolver_impl::utility::duplicate_registration_exception;
+
+        using duplicate_decorator_exception = ::jaszyk::dependency_resolver_impl::utility::duplicate_decorator_exception;
+
+        using scoped_dependency_exception = ::jaszyk::dependency_resolver_impl::utility::scoped_dependency_exception;
+
+        template <typename TService>
+        using singleton_binding = ::jaszyk::dependency_resolver_impl::utility::singleton_binding<TService>;
+
+        using registration_policy = ::jaszyk::dependency_resolver_impl::utility::registration_policy;
+
+        using memory_statistics = ::jaszyk::dependency_resolver_impl::utility::memory_statistics;
+
+        using registrar = dependency_registrar;
+
+        // using injection_constructor = inject<std::shared_ptr<TArgs>...>; in a service skips the constructor probe
+        template <typename... TArgs>
+        using inject = ::jaszyk::dependency_resolver_impl::utility::inject<TArgs...>;
+
+        // using dependency_bundle = scoped_bundle; in an aggregate makes it a dependency bundle
+        using singleton_bundle = ::jaszyk::dependency_resolver_impl::utility::bundle<::jaszyk::dependency_resolver_impl::utility::service_lifetime::singleton>;
+
+        using scoped_bundle = ::jaszyk::dependency_resolver_impl::utility::bundle<::jaszyk::dependency_resolver_impl::utility::service_lifetime::scoped>;
+
+        using transient_bundle = ::jaszyk::dependency_resolver_impl::utility::bundle<::jaszyk::dependency_resolver_impl::utility::service_lifetime::transient>;
+
+        inline dependency_resolver() = default;
+
+        inline dependency_resolver(const dependency_resolver& other) = delete;
+
+        inline dependency_resolver(dependency_resolver&& other) noexcept = default;
+
+        inline dependency_resolver& operator=(const dependency_resolver& other) = delete;
+
+        inline dependency_resolver& operator=(dependency_resolver&& other) noexcept = default;
+
+        // TProvided - services registered by the module, configure runs on the first resolve of any of them.
+        // Registrations colliding with existing ones follow the registration policy, except that
+        // replace and append throw duplicate_registration_exception, as tapes may have read the binding.
+        template <typename... TProvided>
+        inline void add_module(std::function<void(registrar&)> configure) {
+            data_.add_module({ ::jaszyk::dependency_resolver_impl::utility::key_of<TProvided>()... },
+                [configure](extensible_tuple& tuple) {
+                    registrar handle(tuple);
+                    configure(handle);
+                });
+        }
+
+#ifdef JASZYK_DEPENDENCY_RESOLVER_DIAGNOSTICS
+        using service_observer = ::jaszyk::dependency_resolver_impl::utility::service_observer;
+
+        // called with every instance the resolver constructs; add observers before resolving
+        inline void add_observer(service_observer observer) {
+            data_.add_observer(std::move(observer));
+        }
+#endif
+
+        template <typename T>
+        inline std::shared_ptr<T> resolve(scope& scope) const {
+            return data_.resolve_object<T>(static_cast<scope_storage&>(scope));
+        }
+
+        template <typename T>
         inline std::shared_ptr<T> resolve(temporary_scope) const {
             scope_type scope;
-            return data_.resolve_object<T>(static_cast<extensible_tuple&>(scope));
+            return data_.resolve_object<T>(static_cast<scope_storage&>(scope));
         }
 
         template <typename T>
@@ -509,23 +2530,279 @@ namespace reflections {
 			return data_.resolve_object<T>();
 		}
 
+        // every binding of T registered with registration_policy::append, oldest first
+        template <typename T>
+        inline std::vector<std::shared_ptr<T>> resolve_all(scope& scope) const {
+            return data_.resolve_all<T>(&scope);
+        }
+
+        template <typename T>
+        inline std::vector<std::shared_ptr<T>> resolve_all(temporary_scope) const {
+            scope_type scope;
+            return data_.resolve_all<T>(&scope);
+        }
+
+        template <typename T>
+        inline std::vector<std::shared_ptr<T>> resolve_all() const {
+            return data_.resolve_all<T>(nullptr);
+        }
+
+        // removes all bindings of T, returns false if T isn't registered
+        template <typename T>
+        inline bool remove() {
+            return data_.remove<T>();
+        }
+
+        // reclaims entries of rebound and removed services
+        inline void compact() {
+            data_.compact();
+        }
+
+        template <typename... TRoots>
+        inline void seal() {
+            int expand[] = { 0, (data_.prepare<TRoots>(), 0)... };
+            (void)expand;
+            data_.seal();
+        }
+
+        // Applies all contributions (e.g. of plugins) and folds them into the resolver
+        // at once: a sealed resolver is resealed a single time, with TRoots added.
+        template <typename... TRoots>
+        inline void extend(const std::vector<std::function<void(registrar&)>>& contributions) {
+            registrar handle(data_);
+
+            for (const auto& contribute : contributions) {
+                contribute(handle);
+            }
+
+            if (data_.sealed() || sizeof...(TRoots) != 0) {
+                seal<TRoots...>();
+            }
+        }
+
+        inline bool sealed() const {
+            return data_.sealed();
+        }
+
+        // whether the resolution tape of T is compiled
+        template <typename T>
+        inline bool prepared() const {
+            return data_.compiled<T>();
+        }
+
+        inline void set_registration_policy(registration_policy policy) {
+            data_.set_policy(policy);
+        }
+
+        inline registration_policy get_registration_policy() const {
+            return data_.policy();
+        }
+
         inline size_t size() const {
             return data_.size();
         }
 
+        // starts the hosted singletons, dependencies first; see hosted services
+        inline void start_hosted_services() {
+            data_.start_hosted();
+        }
+
+        // stops what start_hosted_services() started, dependents first; false if
+        // some services were still stopping when timeout ran out
+        template <typename TRep, typename TPeriod>
+        inline bool stop_hosted_services(std::chrono::duration<TRep, TPeriod> timeout) {
+            return data_.stop_hosted(std::chrono::steady_clock::now() + timeout);
+        }
+
+        // rebuilds every expiring service now instead of ahead of expiry; see expiring services
+        inline void refresh_expiring_services() const {
+            data_.refresh_expiring();
+        }
+
+        // estimated bytes held by the registrations, singletons and compiled tapes
+        inline memory_statistics memory_stats() const {
+            return data_.memory_stats(nullptr);
+        }
+
+        // as memory_stats(), including the slots and instances of scope
+        inline memory_statistics memory_stats(const scope& scope) const {
+            return data_.memory_stats(&scope);
+        }
+
         inline scope make_scope() const {
 			return scope();
 		}
 
+        // copy of all registrations except TExcluded; singleton instances are shared
+        template <typename... TExcluded>
+        inline dependency_resolver clone() const {
+            return dependency_resolver(data_.clone({ ::jaszyk::dependency_resolver_impl::utility::key_of<TExcluded>()... }));
+        }
+
     private:
+        friend class ::jaszyk::dependency_resolver_impl::utility::registration_api<dependency_resolver>;
+        friend class concurrent_resolver;
+
+        inline explicit dependency_resolver(extensible_tuple data)
+            : data_(std::move(data)) { }
+
+        inline extensible_tuple& tuple() {
+            return data_;
+        }
+
         extensible_tuple data_;
     };
 
-    dependency_resolver::scope dependency_resolver::global_scope = dependency_resolver::scope();
+    /*
+        Resolver whose registrations can be replaced while it is being used.
+
+        Every version of the registrations is an immutable dependency_resolver.
+        Resolving announces itself in the counter of the current epoch and loads the
+        current version with a single atomic load - it never takes a lock.
+        Publishing swaps the version pointer, moves to the next epoch and waits until
+        resolves announced in the previous epoch are done before the old version is
+        destroyed. Writers are serialized with each other only.
+
+        Versions are sealed. Before it is published, a version compiles and seals
+        every root the current one has compiled, so resolving them stays lock-free
+        across versions.
+
+        Scopes outlive versions. A scope filled by another version is moved to the
+        slots of the current one on its first resolve; instances the current version
+        doesn't store in scopes are kept until the scope ends.
+
+        rebind<TRebound...>(configure) - publishes a copy of the current version without
+            TRebound, with configure applied to it
+        publish(next) - publishes next as the current version
+    */
+    class concurrent_resolver {
+    public:
+        using scope = dependency_resolver::scope;
+
+        inline explicit concurrent_resolver(dependency_resolver initial)
+            : current_(new dependency_resolver(std::move(initial)))
+        {
+            current_.load()->data_.seal();
+        }
+
+        concurrent_resolver(const concurrent_resolver& other) = delete;
+
+        concurrent_resolver& operator=(const concurrent_resolver& other) = delete;
+
+        inline ~concurrent_resolver() {
+            delete current_.load();
+        }
+
+        template <typename T>
+        inline std::shared_ptr<T> resolve() const {
+            read_guard guard(*this);
+            return current_.load()->resolve<T>();
+        }
+
+        template <typename T>
+        inline std::shared_ptr<T> resolve(scope& scope) const {
+            read_guard guard(*this);
+            return current_.load()->resolve<T>(scope);
+        }
+
+        template <typename... TRebound>
+        inline void rebind(const std::function<void(dependency_resolver&)>& configure) {
+            std::lock_guard<std::mutex> lock(writer_);
+
+            dependency_resolver next = current_.load()->clone<TRebound...>();
+            configure(next);
+
+            replace(std::move(next));
+        }
+
+        inline void publish(dependency_resolver next) {
+            std::lock_guard<std::mutex> lock(writer_);
+            replace(std::move(next));
+        }
+
+        inline std::size_t version() const {
+            return epoch_.load();
+        }
+
+        inline bool sealed() const {
+            read_guard guard(*this);
+            return current_.load()->sealed();
+        }
+
+        template <typename T>
+        inline bool prepared() const {
+            read_guard guard(*this);
+            return current_.load()->prepared<T>();
+        }
+
+    private:
+        // padded, so that readers of both epochs don't share a cache line
+        struct reader_counter {
+            std::atomic<std::size_t> count{ 0 };
+            char padding[64 - sizeof(std::atomic<std::size_t>)];
+        };
+
+        class read_guard {
+        public:
+            inline explicit read_guard(const concurrent_resolver& owner)
+                : owner_(owner)
+            {
+                for (;;) {
+                    epoch_ = owner_.epoch_.load();
+                    owner_.readers_[epoch_ & 1].count.fetch_add(1);
+
+                    if (owner_.epoch_.load() == epoch_) {
+                        break;
+                    }
+
+                    owner_.readers_[epoch_ & 1].count.fetch_sub(1);
+                }
+            }
+
+            inline ~read_guard() {
+                owner_.readers_[epoch_ & 1].count.fetch_sub(1);
+            }
+
+        private:
+            const concurrent_resolver& owner_;
+            std::size_t epoch_;
+        };
+
+        // next is sealed with the roots the current version compiled, so that its
+        // resolves don't take the lock of the tape cache
+        void replace(dependency_resolver next);
+
+        std::atomic<dependency_resolver*> current_;
+        std::atomic<std::size_t> epoch_{ 0 };
+        mutable reader_counter readers_[2];
+        std::mutex writer_;
+    };
+} // inline namespace JASZYK_DEPENDENCY_RESOLVER_ABI
 } // namespace app
 
+#define JASZYK_OPEN_GENERIC(TInterface, TService) \
+    namespace jaszyk { inline namespace JASZYK_DEPENDENCY_RESOLVER_ABI { namespace dependency_resolver_impl { namespace utility { \
+        template <> \
+        struct open_generic<TInterface> { \
+            template <typename... TArgs> \
+            using implementation = TService<TArgs...>; \
+            using implementation_key = template_key<TService>; \
+        }; \
+    } } } }
+
+// TService is built with its constructor taking the given arguments, no other is probed
+#define JASZYK_INJECTION_CONSTRUCTOR(TService, ...) \
+    namespace jaszyk { inline namespace JASZYK_DEPENDENCY_RESOLVER_ABI { namespace dependency_resolver_impl { namespace utility { \
+        template <> \
+        struct injection_constructor<TService> : inject<__VA_ARGS__> { }; \
+    } } } }
+
 namespace cofftea {
     using namespace jaszyk;
 }
 
+#ifndef JASZYK_DEPENDENCY_RESOLVER_SEPARATE_COMPILATION
+#include "dependency_resolver.ipp"
+#endif
+
 #endif // !__JASZYK_DEPENDENCY_RESOLVER_HPP__
\ No newline at end of file
@@ -0,0 +1,1304 @@
+#pragma once
+#ifndef __JASZYK_DEPENDENCY_RESOLVER_IPP__
+#define __JASZYK_DEPENDENCY_RESOLVER_IPP__
+#include "dependency_resolver.hpp"
+#include <condition_variable>
+#include <set>
+#include <thread>
+
+/*
+    Non-template core of the resolver: service table maintenance, tape compiler
+    and interpreter, diagnostics.
+
+    Included by dependency_resolver.hpp, where the functions are inline, unless
+    JASZYK_DEPENDENCY_RESOLVER_SEPARATE_COMPILATION is defined; then it is compiled
+    once into the dependency_resolver library (src/dependency_resolver.cpp).
+*/
+
+namespace jaszyk {
+inline namespace JASZYK_DEPENDENCY_RESOLVER_ABI {
+namespace dependency_resolver_impl {
+namespace utility {
+
+    JASZYK_DEPENDENCY_RESOLVER_DECL void expiring_service::publish(std::shared_ptr<void> instance) {
+        const std::size_t previous = current.load();
+        instances[previous ^ 1] = std::move(instance);
+        current.store(previous ^ 1);
+
+        while (readers[previous].load() != 0) {
+            std::this_thread::yield();
+        }
+
+        instances[previous].reset();
+    }
+
+    struct expiring_refresher {
+        inline ~expiring_refresher() {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                stopping = true;
+            }
+
+            wake.notify_all();
+
+            if (thread.joinable()) {
+                thread.join();
+            }
+        }
+
+        std::mutex mutex;
+        std::condition_variable wake;
+        bool stopping = false;
+        // services were added or the tuple moved since the thread last looked
+        bool changed = false;
+        // the thread is rebuilding services without the lock
+        bool refreshing = false;
+        // tuple the services are rebuilt from, null while it moves
+        const extensible_tuple* owner = nullptr;
+        std::vector<std::weak_ptr<expiring_service>> services;
+        std::thread thread;
+    };
+
+    JASZYK_DEPENDENCY_RESOLVER_DECL refresher_slot::refresher_slot() = default;
+
+    JASZYK_DEPENDENCY_RESOLVER_DECL refresher_slot::refresher_slot(refresher_slot&& other) noexcept
+        : refresher(other.pause()) { }
+
+    JASZYK_DEPENDENCY_RESOLVER_DECL refresher_slot& refresher_slot::operator=(refresher_slot&& other) noexcept {
+        stop();
+        std::unique_ptr<expiring_refresher> paused = other.pause();
+
+        std::lock_guard<std::mutex> lock(mutex);
+        closed = false;
+        refresher = std::move(paused);
+        return *this;
+    }
+
+    JASZYK_DEPENDENCY_RESOLVER_DECL refresher_slot::~refresher_slot() = default;
+
+    JASZYK_DEPENDENCY_RESOLVER_DECL void refresher_slot::stop() {
+        std::unique_ptr<expiring_refresher> stopped;
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            closed = true;
+            stopped = std::move(refresher);
+        }
+    }
+
+    JASZYK_DEPENDENCY_RESOLVER_DECL void refresher_slot::resume(const extensible_tuple* owner) {
+        std::lock_guard<std::mutex> lock(mutex);
+
+        if (refresher) {
+            {
+                std::lock_guard<std::mutex> refresher_lock(refresher->mutex);
+                refresher->owner = owner;
+                refresher->changed = true;
+            }
+
+            refresher->wake.notify_all();
+        }
+    }
+
+    JASZYK_DEPENDENCY_RESOLVER_DECL std::unique_ptr<expiring_refresher> refresher_slot::pause() {
+        std::unique_ptr<expiring_refresher> paused;
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            closed = true;
+            paused = std::move(refresher);
+        }
+
+        if (paused) {
+            std::unique_lock<std::mutex> lock(paused->mutex);
+            paused->owner = nullptr;
+            paused->wake.wait(lock, [&paused] { return !paused->refreshing; });
+        }
+
+        return paused;
+    }
+
+    struct tape_pins {
+        std::mutex mutex;
+        std::condition_variable unpinned;
+        std::size_t count = 0;
+    };
+
+    JASZYK_DEPENDENCY_RESOLVER_DECL tape_cache::tape_cache()
+        : pins_(std::make_shared<tape_pins>()) { }
+
+    JASZYK_DEPENDENCY_RESOLVER_DECL tape_cache::tape_cache(tape_cache&& other) noexcept
+        : tapes(std::move(other.tapes)), dependents(std::move(other.dependents)), pins_(std::make_shared<tape_pins>()) { }
+
+    JASZYK_DEPENDENCY_RESOLVER_DECL tape_cache& tape_cache::operator=(tape_cache&& other) noexcept {
+        tapes = std::move(other.tapes);
+        dependents = std::move(other.dependents);
+        return *this;
+    }
+
+    JASZYK_DEPENDENCY_RESOLVER_DECL void tape_cache::pin() {
+        std::lock_guard<std::mutex> lock(pins_->mutex);
+        ++pins_->count;
+    }
+
+    JASZYK_DEPENDENCY_RESOLVER_DECL void tape_cache::unpin() {
+        {
+            std::lock_guard<std::mutex> lock(pins_->mutex);
+            --pins_->count;
+        }
+
+        pins_->unpinned.notify_all();
+    }
+
+    JASZYK_DEPENDENCY_RESOLVER_DECL void tape_cache::wait_unpinned() {
+        std::unique_lock<std::mutex> lock(pins_->mutex);
+        pins_->unpinned.wait(lock, [this] { return pins_->count == 0; });
+    }
+
+    struct hosted_stop {
+        std::mutex mutex;
+        std::condition_variable stopped;
+        bool finished = false;
+    };
+
+    JASZYK_DEPENDENCY_RESOLVER_DECL extensible_tuple::extensible_tuple() {
+        metadata_.reserve(4);
+    }
+
+    // the refresher of other is paused while the rest moves, then rebuilds from this tuple
+    JASZYK_DEPENDENCY_RESOLVER_DECL extensible_tuple::extensible_tuple(extensible_tuple&& other) noexcept
+        : refresher_(std::move(other.refresher_))
+        , entries_(std::move(other.entries_))
+        , metadata_(std::move(other.metadata_))
+        , type_index_map_(std::move(other.type_index_map_))
+        , appended_(std::move(other.appended_))
+        , dead_(std::move(other.dead_))
+        , scope_slots_(std::move(other.scope_slots_))
+        , scope_layout_(std::move(other.scope_layout_))
+        , open_generics_(std::move(other.open_generics_))
+        , decorations_(std::move(other.decorations_))
+        , modules_(std::move(other.modules_))
+        , pending_modules_(std::move(other.pending_modules_))
+        , materializing_(std::move(other.materializing_))
+        , observers_(std::move(other.observers_))
+        , hosted_(std::move(other.hosted_))
+        , stopping_(std::move(other.stopping_))
+        , policy_(std::move(other.policy_))
+        , sealed_tapes_(std::move(other.sealed_tapes_))
+        , sealed_index_(std::move(other.sealed_index_))
+        , sealed_(std::move(other.sealed_))
+        , tapes_(std::move(other.tapes_))
+    {
+        refresher_.resume(this);
+    }
+
+    // stops the refresher of this tuple before its services are replaced
+    JASZYK_DEPENDENCY_RESOLVER_DECL extensible_tuple& extensible_tuple::operator=(extensible_tuple&& other) noexcept {
+        refresher_ = std::move(other.refresher_);
+        entries_ = std::move(other.entries_);
+        metadata_ = std::move(other.metadata_);
+        type_index_map_ = std::move(other.type_index_map_);
+        appended_ = std::move(other.appended_);
+        dead_ = std::move(other.dead_);
+        scope_slots_ = std::move(other.scope_slots_);
+        scope_layout_ = std::move(other.scope_layout_);
+        open_generics_ = std::move(other.open_generics_);
+        decorations_ = std::move(other.decorations_);
+        modules_ = std::move(other.modules_);
+        pending_modules_ = std::move(other.pending_modules_);
+        materializing_ = std::move(other.materializing_);
+        observers_ = std::move(other.observers_);
+        hosted_ = std::move(other.hosted_);
+        stopping_ = std::move(other.stopping_);
+        policy_ = std::move(other.policy_);
+        sealed_tapes_ = std::move(other.sealed_tapes_);
+        sealed_index_ = std::move(other.sealed_index_);
+        sealed_ = std::move(other.sealed_);
+        tapes_ = std::move(other.tapes_);
+        refresher_.resume(this);
+        return *this;
+    }
+
+    // the refresher is destroyed last, its thread must not outlive the rest
+    JASZYK_DEPENDENCY_RESOLVER_DECL extensible_tuple::~extensible_tuple() {
+        refresher_.stop();
+    }
+
+    // Tapes of the services that were rebound or removed are dropped already,
+    // the remaining ones only read live entries and are pointed at their new place.
+    JASZYK_DEPENDENCY_RESOLVER_DECL void extensible_tuple::compact() {
+        std::lock_guard<std::recursive_mutex> lock(tapes_.mutex);
+
+        if (dead_ == 0) {
+            return;
+        }
+
+        tapes_.wait_unpinned();
+
+        constexpr std::size_t dead = static_cast<std::size_t>(-1);
+
+        std::vector<std::size_t> moved(entries_.size(), dead);
+        std::map<const service_entry*, const service_entry*> retargeted;
+        service_table entries;
+        std::vector<service_metadata> metadata;
+
+        for_each_binding([&](std::size_t index) {
+            moved[index] = 0;
+        });
+
+        for (std::size_t index = 0; index < entries_.size(); ++index) {
+            if (moved[index] != dead) {
+                moved[index] = entries.size();
+                retargeted[&entries_[index]] = &entries.push_back(std::move(entries_[index]));
+                metadata.push_back(metadata_[index]);
+            }
+        }
+
+        for (auto& service : type_index_map_) {
+            service.second = moved[service.second];
+        }
+
+        for (auto& bindings : appended_) {
+            for (std::size_t& index : bindings.second) {
+                index = moved[index];
+            }
+        }
+
+        const auto retarget = [&](std::map<service_key, resolution_tape>& tapes) {
+            for (auto& tape : tapes) {
+                for (tape_instruction& instruction : tape.second.code) {
+                    if (instruction.entry != nullptr) {
+                        instruction.entry = retargeted[instruction.entry];
+                    }
+                }
+            }
+        };
+
+        retarget(tapes_.tapes);
+        retarget(sealed_tapes_);
+
+        entries_ = std::move(entries);
+        metadata_ = std::move(metadata);
+        dead_ = 0;
+    }
+
+    JASZYK_DEPENDENCY_RESOLVER_DECL void extensible_tuple::seal() {
+        std::lock_guard<std::recursive_mutex> lock(tapes_.mutex);
+        tapes_.wait_unpinned();
+
+        for (auto& tape : tapes_.tapes) {
+            sealed_tapes_.insert(std::move(tape));
+        }
+
+        tapes_.tapes.clear();
+
+        std::vector<std::pair<service_key, const resolution_tape*>> roots;
+
+        for (const auto& tape : sealed_tapes_) {
+            roots.push_back({ tape.first, &tape.second });
+        }
+
+        if (!sealed_index_.build(roots)) {
+            sealed_index_.clear();
+        }
+
+        sealed_ = true;
+    }
+
+    JASZYK_DEPENDENCY_RESOLVER_DECL void extensible_tuple::reseal(const extensible_tuple& source) {
+        std::vector<std::pair<service_key, tape_compiler>> roots;
+
+        {
+            // source may be compiling tapes for the resolves it serves
+            std::lock_guard<std::recursive_mutex> lock(source.tapes_.mutex);
+
+            for (const auto& tape : source.sealed_tapes_) {
+                roots.push_back({ tape.first, tape.second.compile });
+            }
+
+            for (const auto& tape : source.tapes_.tapes) {
+                roots.push_back({ tape.first, tape.second.compile });
+            }
+        }
+
+        for (const auto& root : roots) {
+            if (root.second == nullptr || sealed_tape(root.first) != nullptr || tapes_.tapes.count(root.first) != 0) {
+                continue;
+            }
+
+            // a root that no longer compiles is left to fail on its first resolve
+            try {
+                cache_tape(root.first, root.second(*this));
+            }
+            catch (...) {
+            }
+        }
+
+        seal();
+    }
+
+    JASZYK_DEPENDENCY_RESOLVER_DECL bool extensible_tuple::sealed() const {
+        return sealed_;
+    }
+
+    JASZYK_DEPENDENCY_RESOLVER_DECL void extensible_tuple::set_policy(registration_policy policy) {
+        std::lock_guard<std::recursive_mutex> lock(tapes_.mutex);
+        policy_ = policy;
+    }
+
+    JASZYK_DEPENDENCY_RESOLVER_DECL registration_policy extensible_tuple::policy() const {
+        return policy_;
+    }
+
+    JASZYK_DEPENDENCY_RESOLVER_DECL size_t extensible_tuple::size() const {
+        return services();
+    }
+
+    JASZYK_DEPENDENCY_RESOLVER_DECL std::size_t extensible_tuple::services() const {
+        std::size_t inner = 0;
+
+        for (const auto& layers : decorations_) {
+            inner += layers.second.size();
+        }
+
+        return type_index_map_.size() - inner;
+    }
+
+    JASZYK_DEPENDENCY_RESOLVER_DECL void extensible_tuple::drop_decorations(const service_key& key) {
+        auto layers = decorations_.find(key);
+
+        if (layers == decorations_.end()) {
+            return;
+        }
+
+        for (const service_key& inner : layers->second) {
+            if (type_index_map_.erase(inner) != 0) {
+                ++dead_;
+            }
+
+            invalidate(inner);
+        }
+
+        decorations_.erase(layers);
+    }
+
+    JASZYK_DEPENDENCY_RESOLVER_DECL memory_statistics extensible_tuple::memory_stats(const scope_storage* scope) const {
+        std::lock_guard<std::recursive_mutex> lock(tapes_.mutex);
+
+        memory_statistics stats;
+        stats.services = services();
+        stats.entries = entries_.size();
+
+        stats.registry_bytes = sizeof(*this)
+            + entries_.bytes()
+            + metadata_.capacity() * sizeof(service_metadata)
+            + map_bytes(type_index_map_)
+            + map_bytes(appended_)
+            + map_bytes(scope_slots_)
+            + (scope_layout_ ? sizeof(scope_layout) + scope_layout_->types.capacity() * sizeof(type_id)
+                + scope_layout_->sizes.capacity() * sizeof(std::size_t) : 0)
+            + map_bytes(open_generics_)
+            + map_bytes(decorations_)
+            + map_bytes(pending_modules_)
+            + modules_.capacity() * sizeof(lazy_module);
+
+        for (const auto& bindings : appended_) {
+            stats.registry_bytes += bindings.second.capacity() * sizeof(std::size_t);
+        }
+
+        for (const lazy_module& module : modules_) {
+            stats.registry_bytes += module.provides.capacity() * sizeof(service_key);
+        }
+
+        // an instance exposed under several interfaces is counted once
+        std::set<std::shared_ptr<void>, std::owner_less<std::shared_ptr<void>>> instances;
+
+        for_each_binding([&](std::size_t index) {
+            const service_entry& entry = entries_[index];
+
+            if (entry.lifetime() == service_lifetime::singleton && instances.insert(entry.instance()).second) {
+                stats.singleton_bytes += metadata_[index].instance_size + control_block_size();
+            }
+            else if (entry.lifetime() == service_lifetime::expiring && instances.insert(entry.instance()).second) {
+                stats.singleton_bytes += metadata_[index].instance_size + sizeof(expiring_service) + 2 * control_block_size();
+            }
+        });
+
+        stats.singletons = instances.size();
+
+        const auto measure = [&](const std::map<service_key, resolution_tape>& tapes) {
+            stats.tapes += tapes.size();
+            stats.tape_bytes += map_bytes(tapes);
+
+            for (const auto& tape : tapes) {
+                stats.tape_bytes += tape.second.code.capacity() * sizeof(tape_instruction)
+                    + tape.second.names.capacity() * sizeof(const char*)
+                    + tape.second.services.capacity() * sizeof(service_key);
+            }
+        };
+
+        measure(tapes_.tapes);
+        measure(sealed_tapes_);
+
+        stats.tape_bytes += map_bytes(tapes_.dependents) + sealed_index_.bytes();
+
+        for (const auto& dependents : tapes_.dependents) {
+            stats.tape_bytes += dependents.second.capacity() * sizeof(service_key);
+        }
+
+        if (scope != nullptr) {
+            const auto& slots = scope->slots();
+            stats.scope_bytes = sizeof(*scope) + slots.capacity() * sizeof(std::shared_ptr<void>);
+
+            for (std::size_t slot = 0; slot < slots.size(); ++slot) {
+                if (slots[slot]) {
+                    ++stats.scoped_instances;
+                    stats.scope_bytes += scope->layout()->sizes[slot] + control_block_size();
+                }
+            }
+        }
+
+        return stats;
+    }
+
+    JASZYK_DEPENDENCY_RESOLVER_DECL extensible_tuple extensible_tuple::clone(const std::vector<service_key>& excluded) const {
+        // services may be bound by resolves running on the source at the same time
+        std::lock_guard<std::recursive_mutex> lock(tapes_.mutex);
+
+        // the inner bindings of an excluded decorated service go with it
+        std::vector<service_key> dropped = excluded;
+
+        for (const service_key& key : excluded) {
+            auto layers = decorations_.find(key);
+
+            if (layers != decorations_.end()) {
+                dropped.insert(dropped.end(), layers->second.begin(), layers->second.end());
+            }
+        }
+
+        const auto is_excluded = [&](const service_key& key) {
+            return std::find(dropped.begin(), dropped.end(), key) != dropped.end();
+        };
+
+        std::vector<std::size_t> moved(entries_.size(), 0);
+
+        for (const auto& service : type_index_map_) {
+            moved[service.second] = !is_excluded(service.first);
+        }
+
+        for (const auto& bindings : appended_) {
+            for (std::size_t index : bindings.second) {
+                moved[index] = !is_excluded(bindings.first);
+            }
+        }
+
+        extensible_tuple copy;
+
+        for (std::size_t index = 0; index < entries_.size(); ++index) {
+            if (moved[index] != 0) {
+                moved[index] = copy.push_entry(entries_[index], metadata_[index]);
+            }
+        }
+
+        for (const auto& service : type_index_map_) {
+            if (!is_excluded(service.first)) {
+                copy.type_index_map_.insert({ service.first, moved[service.second] });
+            }
+        }
+
+        for (const auto& bindings : appended_) {
+            if (!is_excluded(bindings.first)) {
+                for (std::size_t index : bindings.second) {
+                    copy.appended_[bindings.first].push_back(moved[index]);
+                }
+            }
+        }
+
+        copy.scope_slots_ = scope_slots_;
+        copy.scope_layout_ = scope_layout_;
+        copy.open_generics_ = open_generics_;
+        copy.modules_ = modules_;
+
+        for (const auto& layers : decorations_) {
+            if (!is_excluded(layers.first)) {
+                copy.decorations_.insert(layers);
+            }
+        }
+
+        copy.pending_modules_ = pending_modules_;
+        copy.policy_ = policy_;
+        copy.observers_ = observers_;
+        copy.hosted_ = hosted_;
+        copy.drop_hosted();
+
+        for (const service_key& key : excluded) {
+            copy.pending_modules_.erase(key);
+        }
+
+        // shared with this tuple, the copy rebuilds them as well once this one is gone
+        copy.for_each_binding([&copy](std::size_t index) {
+            const service_entry& entry = copy.entries_[index];
+
+            if (entry.lifetime() == service_lifetime::expiring) {
+                copy.watch(std::static_pointer_cast<expiring_service>(entry.instance()));
+            }
+        });
+
+        return copy;
+    }
+
+    JASZYK_DEPENDENCY_RESOLVER_DECL void extensible_tuple::add_observer(service_observer observer) {
+        std::lock_guard<std::recursive_mutex> lock(tapes_.mutex);
+        tapes_.wait_unpinned();
+        observers_.push_back(std::move(observer));
+    }
+
+    JASZYK_DEPENDENCY_RESOLVER_DECL std::size_t extensible_tuple::hosted_level(std::size_t index, std::vector<std::size_t>& levels) const {
+        if (levels[index] != 0) {
+            return levels[index];
+        }
+
+        // hosted services reached through the dependencies of this one, which stop the walk
+        std::size_t level = 1;
+        std::set<std::size_t> visited;
+        std::vector<const std::vector<dependency>*> pending{ &hosted_[index]->dependencies() };
+
+        while (!pending.empty()) {
+            const std::vector<dependency>& dependencies = *pending.back();
+            pending.pop_back();
+
+            for (const dependency& next : dependencies) {
+                auto it = type_index_map_.find(next.key);
+
+                if (it == type_index_map_.end() || !visited.insert(it->second).second) {
+                    continue;
+                }
+
+                const service_entry& entry = entries_[it->second];
+                std::size_t hosted = hosted_.size();
+
+                if (entry.lifetime() == service_lifetime::singleton) {
+                    for (hosted = 0; hosted < hosted_.size(); ++hosted) {
+                        const std::shared_ptr<void>& instance = hosted_[hosted]->instance;
+
+                        if (!instance.owner_before(entry.instance()) && !entry.instance().owner_before(instance)) {
+                            break;
+                        }
+                    }
+                }
+
+                if (hosted < hosted_.size()) {
+                    level = std::max(level, hosted_level(hosted, levels) + 1);
+                }
+                else {
+                    pending.push_back(&metadata_[it->second].dependencies());
+                }
+            }
+        }
+
+        return levels[index] = level;
+    }
+
+    JASZYK_DEPENDENCY_RESOLVER_DECL std::vector<std::vector<std::size_t>> extensible_tuple::hosted_levels() const {
+        std::vector<std::size_t> levels(hosted_.size(), 0);
+        std::vector<std::vector<std::size_t>> order;
+
+        for (std::size_t index = 0; index < hosted_.size(); ++index) {
+            const std::size_t level = hosted_level(index, levels);
+
+            if (order.size() < level) {
+                order.resize(level);
+            }
+
+            order[level - 1].push_back(index);
+        }
+
+        return order;
+    }
+
+    JASZYK_DEPENDENCY_RESOLVER_DECL void extensible_tuple::start_hosted() {
+        for (const std::vector<std::size_t>& level : hosted_levels()) {
+            std::vector<std::exception_ptr> errors(level.size());
+            std::vector<std::thread> threads;
+
+            const auto start = [this, &level, &errors](std::size_t i) {
+                hosted_service& service = *hosted_[level[i]];
+
+                if (service.started) {
+                    return;
+                }
+
+                try {
+                    service.start(service.instance.get());
+                    service.started = true;
+                }
+                catch (...) {
+                    errors[i] = std::current_exception();
+                }
+            };
+
+            // the calling thread starts the first service of the level itself
+            for (std::size_t i = 1; i < level.size(); ++i) {
+                threads.emplace_back(start, i);
+            }
+
+            start(0);
+
+            for (std::thread& thread : threads) {
+                thread.join();
+            }
+
+            for (const std::exception_ptr& error : errors) {
+                if (error) {
+                    stop_hosted(std::chrono::steady_clock::time_point::max());
+                    std::rethrow_exception(error);
+                }
+            }
+        }
+    }
+
+    JASZYK_DEPENDENCY_RESOLVER_DECL bool extensible_tuple::stop_hosted(std::chrono::steady_clock::time_point deadline) {
+        const auto wait = [deadline](hosted_stop& state) {
+            std::unique_lock<std::mutex> lock(state.mutex);
+            const auto done = [&state] { return state.finished; };
+
+            if (deadline == std::chrono::steady_clock::time_point::max()) {
+                state.stopped.wait(lock, done);
+                return true;
+            }
+
+            return state.stopped.wait_until(lock, deadline, done);
+        };
+
+        // a stop that ran out of its deadline goes on; services started since wait for it
+        if (stopping_ && !wait(*stopping_)) {
+            return false;
+        }
+
+        std::vector<std::vector<std::shared_ptr<hosted_service>>> levels;
+
+        for (const std::vector<std::size_t>& level : hosted_levels()) {
+            levels.emplace(levels.begin());
+
+            for (std::size_t index : level) {
+                levels.front().push_back(hosted_[index]);
+            }
+        }
+
+        stopping_ = std::make_shared<hosted_stop>();
+
+        // refers only to the services, so it may outlive the tuple;
+        // a failing stop still counts as stopped, there is nobody to report it to
+        std::thread([state = stopping_, levels]() {
+            const auto stop = [](const std::shared_ptr<hosted_service>& service) {
+                try {
+                    service->stop(service->instance.get());
+                }
+                catch (...) {
+                }
+            };
+
+            for (const auto& level : levels) {
+                std::vector<std::thread> threads;
+
+                for (const auto& service : level) {
+                    if (service->started.exchange(false)) {
+                        threads.emplace_back(stop, service);
+                    }
+                }
+
+                for (std::thread& thread : threads) {
+                    thread.join();
+                }
+            }
+
+            std::lock_guard<std::mutex> lock(state->mutex);
+            state->finished = true;
+            state->stopped.notify_all();
+        }).detach();
+
+        return wait(*stopping_);
+    }
+
+    JASZYK_DEPENDENCY_RESOLVER_DECL void extensible_tuple::drop_hosted() {
+        if (hosted_.empty()) {
+            return;
+        }
+
+        std::set<std::shared_ptr<void>, std::owner_less<std::shared_ptr<void>>> bound;
+
+        for_each_binding([&](std::size_t index) {
+            if (entries_[index].lifetime() == service_lifetime::singleton) {
+                bound.insert(entries_[index].instance());
+            }
+        });
+
+        std::vector<std::shared_ptr<hosted_service>> kept;
+
+        // latest first, so that dependents stop before what they depend on
+        for (auto service = hosted_.rbegin(); service != hosted_.rend(); ++service) {
+            if (bound.count((*service)->instance) != 0) {
+                kept.insert(kept.begin(), std::move(*service));
+            }
+            // the last resolver hosting a started service stops it, there is nobody to report a failure to
+            else if (service->use_count() == 1 && (*service)->started.exchange(false)) {
+                try {
+                    (*service)->stop((*service)->instance.get());
+                }
+                catch (...) {
+                }
+            }
+        }
+
+        hosted_ = std::move(kept);
+    }
+
+    JASZYK_DEPENDENCY_RESOLVER_DECL std::chrono::steady_clock::time_point extensible_tuple::refresh(expiring_service& service, bool force) const {
+        using clock = std::chrono::steady_clock;
+
+        const clock::duration lead = service.ttl / 4;
+        const clock::time_point now = clock::now();
+        clock::rep expires = service.expires.load();
+
+        if (!force && now < clock::time_point(clock::duration(expires)) - lead) {
+            return clock::time_point(clock::duration(expires)) - lead;
+        }
+
+        // the thread that moves the expiry rebuilds, the others keep the current instance
+        if (!service.expires.compare_exchange_strong(expires, (now + service.ttl).time_since_epoch().count())) {
+            return clock::time_point(clock::duration(expires)) - lead;
+        }
+
+        try {
+            service.publish(service.build(*this));
+        }
+        catch (...) {
+            service.expires.store((now + 2 * lead).time_since_epoch().count());
+            throw;
+        }
+
+        const clock::time_point expiry = clock::now() + service.ttl;
+        service.expires.store(expiry.time_since_epoch().count());
+
+        return expiry - lead;
+    }
+
+    JASZYK_DEPENDENCY_RESOLVER_DECL void extensible_tuple::watch(const std::shared_ptr<expiring_service>& service) const {
+        std::lock_guard<std::mutex> slot_lock(refresher_.mutex);
+
+        if (refresher_.closed) {
+            return;
+        }
+
+        if (!refresher_.refresher) {
+            refresher_.refresher.reset(new expiring_refresher());
+            expiring_refresher& refresher = *refresher_.refresher;
+            refresher.owner = this;
+
+            refresher.thread = std::thread([&refresher]() {
+                std::unique_lock<std::mutex> lock(refresher.mutex);
+
+                while (!refresher.stopping) {
+                    // paused while the tuple moves
+                    if (refresher.owner == nullptr) {
+                        refresher.wake.wait(lock, [&refresher] { return refresher.stopping || refresher.owner != nullptr; });
+                        continue;
+                    }
+
+                    const extensible_tuple& tuple = *refresher.owner;
+                    auto next = std::chrono::steady_clock::time_point::max();
+
+                    // services released by the tuple are dropped, the others refreshed without the lock
+                    refresher.services.erase(std::remove_if(refresher.services.begin(), refresher.services.end(),
+                        [](const std::weak_ptr<expiring_service>& watched) { return watched.expired(); }), refresher.services.end());
+
+                    const auto services = refresher.services;
+                    refresher.changed = false;
+                    refresher.refreshing = true;
+                    lock.unlock();
+
+                    for (const auto& watched : services) {
+                        const auto service = watched.lock();
+
+                        if (!service) {
+                            continue;
+                        }
+
+                        std::chrono::steady_clock::time_point due;
+
+                        // a failed rebuild is retried when due, there is nobody to report it to
+                        try {
+                            due = tuple.refresh(*service, false);
+                        }
+                        catch (...) {
+                            due = std::chrono::steady_clock::time_point(std::chrono::steady_clock::duration(service->expires.load())) - service->ttl / 4;
+                        }
+
+                        next = std::min(next, due);
+                    }
+
+                    lock.lock();
+                    refresher.refreshing = false;
+                    refresher.wake.notify_all();
+                    refresher.wake.wait_until(lock, next, [&refresher] { return refresher.stopping || refresher.changed; });
+                }
+            });
+        }
+
+        expiring_refresher& refresher = *refresher_.refresher;
+
+        {
+            std::lock_guard<std::mutex> lock(refresher.mutex);
+
+            for (const auto& watched : refresher.services) {
+                if (watched.lock() == service) {
+                    return;
+                }
+            }
+
+            refresher.services.push_back(service);
+            refresher.changed = true;
+        }
+
+        refresher.wake.notify_all();
+    }
+
+    JASZYK_DEPENDENCY_RESOLVER_DECL void extensible_tuple::refresh_expiring() const {
+        std::exception_ptr failure;
+
+        for_each_binding([&](std::size_t index) {
+            const service_entry& entry = entries_[index];
+
+            if (entry.lifetime() != service_lifetime::expiring) {
+                return;
+            }
+
+            try {
+                refresh(entry.expiring(), true);
+            }
+            catch (...) {
+                if (!failure) {
+                    failure = std::current_exception();
+                }
+            }
+        });
+
+        if (failure) {
+            std::rethrow_exception(failure);
+        }
+    }
+
+    JASZYK_DEPENDENCY_RESOLVER_DECL bool extensible_tuple::keeps_binding(const service_key& key) const {
+        std::lock_guard<std::recursive_mutex> lock(tapes_.mutex);
+        auto it = type_index_map_.find(key);
+
+        if (it == type_index_map_.end()) {
+            return false;
+        }
+
+        // a module runs while a tape is compiled, which may have read the current binding already
+        if (materializing_ != 0 && policy_ != registration_policy::keep_first) {
+            throw duplicate_registration_exception(metadata_[it->second].name);
+        }
+
+        switch (policy_) {
+        case registration_policy::keep_first:
+            return true;
+        case registration_policy::error:
+            throw duplicate_registration_exception(metadata_[it->second].name);
+        case registration_policy::replace:
+        case registration_policy::append:
+            break;
+        }
+
+        return false;
+    }
+
+    JASZYK_DEPENDENCY_RESOLVER_DECL void extensible_tuple::notify_created(const char* name, const std::shared_ptr<void>& instance) const {
+        for (const service_observer& observer : observers_) {
+            observer(name, instance);
+        }
+    }
+
+    JASZYK_DEPENDENCY_RESOLVER_DECL void extensible_tuple::add_module(std::vector<service_key> provides, module_function configure) {
+        std::lock_guard<std::recursive_mutex> lock(tapes_.mutex);
+
+        for (const service_key& key : provides) {
+            pending_modules_.insert({ key, modules_.size() });
+        }
+
+        modules_.push_back({ std::move(provides), std::move(configure) });
+    }
+
+    JASZYK_DEPENDENCY_RESOLVER_DECL std::size_t extensible_tuple::push_entry(service_entry entry, service_metadata metadata) {
+        entries_.push_back(std::move(entry));
+        metadata_.push_back(metadata);
+        return entries_.size() - 1;
+    }
+
+    JASZYK_DEPENDENCY_RESOLVER_DECL void extensible_tuple::invalidate(const service_key& changed) {
+        auto it = tapes_.dependents.find(changed);
+
+        if (it == tapes_.dependents.end()) {
+            return;
+        }
+
+        tapes_.wait_unpinned();
+
+        for (const service_key& root : it->second) {
+            tapes_.tapes.erase(root);
+            sealed_tapes_.erase(root);
+            sealed_index_.erase(root);
+        }
+
+        tapes_.dependents.erase(it);
+    }
+
+    JASZYK_DEPENDENCY_RESOLVER_DECL bool extensible_tuple::bind(const dependency& missing) {
+        return materialize(missing.key) || (missing.bind != nullptr && missing.bind(*this));
+    }
+
+    JASZYK_DEPENDENCY_RESOLVER_DECL bool extensible_tuple::materialize(const service_key& key) {
+        auto it = pending_modules_.find(key);
+
+        if (it == pending_modules_.end()) {
+            return false;
+        }
+
+        lazy_module& module = modules_[it->second];
+
+        for (const service_key& provided : module.provides) {
+            pending_modules_.erase(provided);
+        }
+
+        struct materializing_guard {
+            int& depth;
+
+            ~materializing_guard() {
+                --depth;
+            }
+        } guard{ ++materializing_ };
+
+        module_function configure = std::move(module.configure);
+        configure(*this);
+
+        return true;
+    }
+
+    JASZYK_DEPENDENCY_RESOLVER_DECL const resolution_tape* extensible_tuple::sealed_tape(const service_key& root) const {
+        if (!sealed_index_.empty()) {
+            const resolution_tape* const* tape = sealed_index_.find(root);
+            return tape != nullptr ? *tape : nullptr;
+        }
+
+        auto it = sealed_tapes_.find(root);
+        return it != sealed_tapes_.end() ? &it->second : nullptr;
+    }
+
+    JASZYK_DEPENDENCY_RESOLVER_DECL const resolution_tape& extensible_tuple::cache_tape(const service_key& root, resolution_tape tape) const {
+        auto it = tapes_.tapes.emplace(root, std::move(tape)).first;
+
+        for (const service_key& service : it->second.services) {
+            std::vector<service_key>& roots = tapes_.dependents[service];
+            auto position = std::lower_bound(roots.begin(), roots.end(), root);
+
+            if (position == roots.end() || *position != root) {
+                roots.insert(position, root);
+            }
+        }
+
+        return it->second;
+    }
+
+    JASZYK_DEPENDENCY_RESOLVER_DECL resolution_tape extensible_tuple::compile_tape(const std::vector<dependency>& root_dependencies, factory_function root,
+        const std::vector<std::size_t>* bindings) const {
+        constexpr std::size_t root_entry = static_cast<std::size_t>(-1);
+
+        struct frame {
+            std::size_t entry;
+            const std::vector<dependency>* dependencies;
+            std::size_t next;
+            std::size_t probe;
+        };
+
+        resolution_tape tape;
+        tape.root = root;
+
+        std::vector<frame> path;
+        path.push_back({ root_entry, &root_dependencies, 0, 0 });
+
+        const std::size_t root_arity = bindings != nullptr ? bindings->size() : root_dependencies.size();
+        std::size_t depth = 0;
+
+        while (!path.empty()) {
+            frame& top = path.back();
+            const bool at_root = path.size() == 1;
+
+            if (top.next == (at_root ? root_arity : top.dependencies->size())) {
+                const auto arity = static_cast<std::uint32_t>(top.next);
+
+                if (top.entry == root_entry) {
+                    if (bindings == nullptr) {
+                        depth = depth - top.next + 1;
+                        tape.code.push_back({ tape_opcode::construct_root, arity, nullptr });
+                    }
+                    path.pop_back();
+                    continue;
+                }
+
+                depth = depth - top.next + 1;
+
+                if (entries_[top.entry].lifetime() == service_lifetime::scoped) {
+                    tape.code[top.probe].operand = static_cast<std::uint32_t>(tape.code.size());
+                    tape.code.push_back({ tape_opcode::construct_scoped, arity, &entries_[top.entry] });
+                }
+                else if (entries_[top.entry].lifetime() == service_lifetime::weak_cached) {
+                    tape.code[top.probe].operand = static_cast<std::uint32_t>(tape.code.size());
+                    tape.code.push_back({ tape_opcode::construct_weak, arity, &entries_[top.entry] });
+                }
+                else {
+                    tape.code.push_back({ tape_opcode::construct, arity, &entries_[top.entry] });
+                }
+
+                tape.names.resize(tape.code.size());
+                tape.names.back() = metadata_[top.entry].name;
+
+                path.pop_back();
+                continue;
+            }
+
+            std::size_t entry;
+
+            if (at_root && bindings != nullptr) {
+                entry = (*bindings)[top.next++];
+            }
+            else {
+                const dependency& next = (*top.dependencies)[top.next++];
+                auto it = type_index_map_.find(next.key);
+
+                // services bound while resolving are a part of the cache as much as tapes are
+                if (it == type_index_map_.end() && const_cast<extensible_tuple*>(this)->bind(next)) {
+                    it = type_index_map_.find(next.key);
+                }
+
+                if (it == type_index_map_.end()) {
+                    throw element_not_found_exception();
+                }
+
+                entry = it->second;
+                tape.services.push_back(next.key);
+            }
+
+            const service_lifetime lifetime = entries_[entry].lifetime();
+
+            if (lifetime == service_lifetime::singleton || lifetime == service_lifetime::expiring) {
+                const tape_opcode load = lifetime == service_lifetime::singleton ? tape_opcode::load_singleton : tape_opcode::load_expiring;
+                tape.code.push_back({ load, 0, &entries_[entry] });
+                tape.max_depth = std::max(tape.max_depth, ++depth);
+                continue;
+            }
+
+            for (const frame& f : path) {
+                if (f.entry == entry) {
+                    throw circular_dependency_exception();
+                }
+
+                if (lifetime == service_lifetime::scoped && f.entry != root_entry && entries_[f.entry].lifetime() == service_lifetime::weak_cached) {
+                    throw scoped_dependency_exception(metadata_[f.entry].name);
+                }
+            }
+
+            const std::size_t probe = tape.code.size();
+
+            if (lifetime == service_lifetime::scoped) {
+                tape.code.push_back({ tape_opcode::load_scoped, 0, &entries_[entry] });
+            }
+            else if (lifetime == service_lifetime::weak_cached) {
+                tape.code.push_back({ tape_opcode::load_weak, 0, &entries_[entry] });
+            }
+
+            path.push_back({ entry, &metadata_[entry].dependencies(), 0, probe });
+        }
+
+        tape.max_depth = std::max(tape.max_depth, depth);
+        tape.names.resize(tape.code.size());
+
+        std::sort(tape.services.begin(), tape.services.end());
+        tape.services.erase(std::unique(tape.services.begin(), tape.services.end()), tape.services.end());
+
+        return tape;
+    }
+
+    JASZYK_DEPENDENCY_RESOLVER_DECL std::shared_ptr<void> extensible_tuple::execute_tape(const resolution_tape& tape, scope_storage* scope) const {
+        std::vector<std::shared_ptr<void>> values;
+        values.reserve(tape.max_depth);
+
+        run_tape(tape, scope, values);
+
+        return std::move(values.back());
+    }
+
+    JASZYK_DEPENDENCY_RESOLVER_DECL void extensible_tuple::adopt_scope(scope_storage& scope) const {
+        std::vector<std::shared_ptr<void>> slots(scope_layout_ ? scope_layout_->types.size() : 0);
+
+        if (const scope_layout* filled = scope.layout()) {
+            for (std::size_t slot = 0; slot < scope.slots().size(); ++slot) {
+                std::shared_ptr<void>& value = scope.slot(slot);
+                auto moved = scope_slots_.find(filled->types[slot]);
+
+                if (value && moved != scope_slots_.end()) {
+                    slots[moved->second] = std::move(value);
+                }
+            }
+        }
+
+        scope.relayout(scope_layout_, std::move(slots));
+    }
+
+    JASZYK_DEPENDENCY_RESOLVER_DECL void extensible_tuple::run_tape(const resolution_tape& tape, scope_storage* scope, std::vector<std::shared_ptr<void>>& values) const {
+        const tape_instruction* const code = tape.code.data();
+        const std::size_t count = tape.code.size();
+
+        // the scope was filled by another version of the registrations, whose slots may differ
+        if (scope != nullptr && scope->layout() != scope_layout_.get()) {
+            adopt_scope(*scope);
+        }
+
+        for (std::size_t i = 0; i < count; ++i) {
+            const tape_instruction& instruction = code[i];
+
+            switch (instruction.opcode) {
+            case tape_opcode::load_singleton:
+                values.push_back(instruction.entry->instance());
+                break;
+
+            case tape_opcode::load_expiring:
+                values.push_back(instruction.entry->expiring().load());
+                break;
+
+            case tape_opcode::load_scoped: {
+                if (scope == nullptr) {
+                    throw missing_scope_exception();
+                }
+
+                const service_entry& entry = *instruction.entry;
+                const std::shared_ptr<void>& value = scope->slot(entry.scope_slot());
+
+                if (value) {
+                    values.push_back(entry.cast()(value));
+                    i = instruction.operand;
+                }
+                break;
+            }
+
+            case tape_opcode::load_weak: {
+                weak_cache& cache = instruction.entry->cache();
+                std::shared_ptr<void> value;
+
+                {
+                    std::lock_guard<std::mutex> lock(cache.mutex);
+                    value = cache.instance.lock();
+                }
+
+                if (value) {
+                    values.push_back(std::move(value));
+                    i = instruction.operand;
+                }
+                break;
+            }
+
+            case tape_opcode::construct: {
+                const std::size_t first = values.size() - instruction.operand;
+                auto value = instruction.entry->factory()(values.data() + first);
+
+#ifdef JASZYK_DEPENDENCY_RESOLVER_DIAGNOSTICS
+                notify_created(tape.names[i], value);
+#endif
+
+                values.resize(first);
+                values.push_back(std::move(value));
+                break;
+            }
+
+            case tape_opcode::construct_scoped: {
+                const service_entry& entry = *instruction.entry;
+                const std::size_t first = values.size() - instruction.operand;
+                auto value = entry.factory()(values.data() + first);
+
+                scope->slot(entry.scope_slot()) = value;
+
+#ifdef JASZYK_DEPENDENCY_RESOLVER_DIAGNOSTICS
+                notify_created(tape.names[i], value);
+#endif
+
+                values.resize(first);
+                values.push_back(entry.cast()(value));
+                break;
+            }
+
+            case tape_opcode::construct_weak: {
+                const service_entry& entry = *instruction.entry;
+                const std::size_t first = values.size() - instruction.operand;
+                auto value = entry.factory()(values.data() + first);
+
+#ifdef JASZYK_DEPENDENCY_RESOLVER_DIAGNOSTICS
+                notify_created(tape.names[i], value);
+#endif
+
+                // released after the lock
+                std::shared_ptr<void> discarded;
+
+                {
+                    weak_cache& cache = entry.cache();
+                    std::lock_guard<std::mutex> lock(cache.mutex);
+                    std::shared_ptr<void> cached = cache.instance.lock();
+
+                    if (cached) {
+                        discarded = std::move(value);
+                        value = std::move(cached);
+                    }
+                    else {
+                        cache.instance = value;
+                    }
+                }
+
+                values.resize(first);
+                values.push_back(std::move(value));
+                break;
+            }
+
+            case tape_opcode::construct_root: {
+                const std::size_t first = values.size() - instruction.operand;
+                auto value = tape.root(values.data() + first);
+
+#ifdef JASZYK_DEPENDENCY_RESOLVER_DIAGNOSTICS
+                notify_created(tape.name, value);
+#endif
+
+                values.resize(first);
+                values.push_back(std::move(value));
+                break;
+            }
+            }
+        }
+    }
+
+} // namespace utility
+} // namespace dependency_resolver_impl
+
+    JASZYK_DEPENDENCY_RESOLVER_DECL void concurrent_resolver::replace(dependency_resolver next) {
+        next.data_.reseal(current_.load()->data_);
+
+        std::unique_ptr<dependency_resolver> old(current_.exchange(new dependency_resolver(std::move(next))));
+
+        const std::size_t epoch = epoch_.fetch_add(1);
+
+        while (readers_[epoch & 1].count.load() != 0) {
+            std::this_thread::yield();
+        }
+    }
+
+} // inline namespace JASZYK_DEPENDENCY_RESOLVER_ABI
+} // namespace jaszyk
+
+#endif // !__JASZYK_DEPENDENCY_RESOLVER_IPP__
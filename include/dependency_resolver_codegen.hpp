@@ -0,0 +1,476 @@
+#pragma once
+#ifndef __JASZYK_DEPENDENCY_RESOLVER_CODEGEN_HPP__
+#define __JASZYK_DEPENDENCY_RESOLVER_CODEGEN_HPP__
+#include "dependency_resolver.hpp"
+#include <algorithm>
+#include <ostream>
+#include <string>
+#include <vector>
+#include <stdexcept>
+
+/*
+    Registration manifest for the wiring generator.
+
+    A manifest describes the same registrations as calls to dependency_resolver,
+    together with the names of the types, which cannot be recovered at runtime:
+
+        JASZYK_DEPENDENCY_MANIFEST(manifest) {
+            manifest.include("services.hpp");
+            JASZYK_MANIFEST_SINGLETON(manifest, ILogger, Logger);
+            JASZYK_MANIFEST_SCOPED(manifest, IRepository, Repository);
+            JASZYK_MANIFEST_TRANSIENT(manifest, Controller, Controller);
+        }
+
+    The generator (tools/codegen, dependency_resolver_generate_wiring in CMake)
+    compiles the manifest, reads constructor signatures with the same reflection
+    as the resolver and emits a header with a plain class wiring every service
+    with direct std::make_shared calls. Lifecycle hooks are called as by the
+    resolver: on_created() once a service is built, on_disposed() from the
+    deleter of its std::shared_ptr.
+
+    Dependency bundles taken by registered services are registered implicitly,
+    as the resolver binds them; an explicit registration of a bundle wins. Their
+    names are read from the compiler's signature of type_name.
+*/
+
+namespace jaszyk {
+inline namespace JASZYK_DEPENDENCY_RESOLVER_ABI {
+namespace codegen {
+
+    // name of T as written in the source, from the signature of this function
+    template <typename T>
+    inline std::string type_name() {
+#if defined(_MSC_VER) && !defined(__clang__)
+        // "... __cdecl jaszyk::codegen::type_name<struct T>(void)"
+        const std::string signature = __FUNCSIG__;
+        const std::size_t first = signature.find("type_name<") + 10;
+        std::string name = signature.substr(first, signature.rfind(">(void)") - first);
+
+        for (const char* keyword : { "struct ", "class ", "enum " }) {
+            for (std::size_t at = name.find(keyword); at != std::string::npos; at = name.find(keyword)) {
+                name.erase(at, std::string(keyword).size());
+            }
+        }
+
+        return name;
+#else
+        // "... type_name() [with T = T; ...]" (GCC), "... type_name() [T = T]" (Clang)
+        const std::string signature = __PRETTY_FUNCTION__;
+        const std::size_t first = signature.find("T = ") + 4;
+        return signature.substr(first, signature.find_first_of(";]", first) - first);
+#endif
+    }
+
+    class manifest {
+        using service_key = ::jaszyk::dependency_resolver_impl::utility::service_key;
+        using service_lifetime = ::jaszyk::dependency_resolver_impl::utility::service_lifetime;
+        using dependencies_function = ::jaszyk::dependency_resolver_impl::utility::dependencies_function;
+        using dependency = ::jaszyk::dependency_resolver_impl::utility::dependency;
+    public:
+        inline void include(const std::string& header) {
+            includes_.push_back(header);
+        }
+
+        template <typename TInterface, typename TService>
+        inline void add_singleton(const std::string& interface_name, const std::string& service_name) {
+            bind_bundles(static_cast<typename ::jaszyk::dependency_resolver_impl::utility::constructor_traits<TService>::arguments*>(nullptr));
+            add<TInterface, TService>(service_lifetime::singleton, interface_name, service_name, 
+                &::jaszyk::dependency_resolver_impl::utility::constructor_traits<TService>::dependencies,
+                ::jaszyk::dependency_resolver_impl::utility::constructor_traits<TService>::aggregate);
+        }
+
+        // singleton provided by the caller of the generated constructor
+        template <typename TInterface>
+        inline void add_instance(const std::string& interface_name) {
+            add<TInterface, TInterface>(service_lifetime::singleton, interface_name, std::string(),
+                &::jaszyk::dependency_resolver_impl::utility::no_dependencies, false);
+            registrations_.back().created = registrations_.back().disposing = false;
+        }
+
+        template <typename TInterface, typename TService>
+        inline void add_transient(const std::string& interface_name, const std::string& service_name) {
+            bind_bundles(static_cast<typename ::jaszyk::dependency_resolver_impl::utility::constructor_traits<TService>::arguments*>(nullptr));
+            add<TInterface, TService>(service_lifetime::transient, interface_name, service_name,
+                &::jaszyk::dependency_resolver_impl::utility::constructor_traits<TService>::dependencies,
+                ::jaszyk::dependency_resolver_impl::utility::constructor_traits<TService>::aggregate);
+        }
+
+        template <typename TInterface, typename TService>
+        inline void add_scoped(const std::string& interface_name, const std::string& service_name) {
+            bind_bundles(static_cast<typename ::jaszyk::dependency_resolver_impl::utility::constructor_traits<TService>::arguments*>(nullptr));
+            add<TInterface, TService>(service_lifetime::scoped, interface_name, service_name,
+                &::jaszyk::dependency_resolver_impl::utility::constructor_traits<TService>::dependencies,
+                ::jaszyk::dependency_resolver_impl::utility::constructor_traits<TService>::aggregate);
+        }
+
+        // throws std::runtime_error if a dependency is missing, circular or needs a scope in a singleton
+        void write(std::ostream& out, const std::string& name_space) const;
+
+    private:
+        struct registration {
+            service_lifetime lifetime;
+            std::string interface_name;
+            std::string service_name;
+            service_key key;
+            service_key implementation;
+            dependencies_function dependencies;
+            bool aggregate;     // brace-initialized with its dependencies
+            bool implicit;      // a bundle nobody registered
+            bool created;       // has on_created()
+            bool disposing;     // has on_disposed()
+        };
+
+        enum class visit_state : unsigned char {
+            none,
+            visiting,
+            visited
+        };
+
+        template <typename TInterface, typename TService>
+        inline void add(service_lifetime lifetime, const std::string& interface_name, const std::string& service_name, dependencies_function dependencies, bool aggregate,
+            bool implicit = false) {
+            registrations_.push_back({ lifetime, interface_name, service_name,
+                ::jaszyk::dependency_resolver_impl::utility::key_of<TInterface>(),
+                ::jaszyk::dependency_resolver_impl::utility::type_id_of<TService>(), dependencies, aggregate, implicit,
+                ::jaszyk::dependency_resolver_impl::utility::has_on_created<TService>::value,
+                ::jaszyk::dependency_resolver_impl::utility::has_on_disposed<TService>::value });
+        }
+
+        // registered ahead of their consumer, so that singletons are created in order
+        template <typename... TArguments>
+        inline void bind_bundles(std::tuple<TArguments...>*) {
+            int expand[] = { 0, (bind_bundle<TArguments>(0), 0)... };
+            (void)expand;
+        }
+
+        template <typename TArgument>
+        inline void bind_bundle(long) { }
+
+        template <typename TArgument, typename TBundle = typename TArgument::element_type, typename = typename TBundle::dependency_bundle>
+        inline void bind_bundle(int) {
+            using traits = ::jaszyk::dependency_resolver_impl::utility::constructor_traits<TBundle>;
+
+            for (const registration& r : registrations_) {
+                if (r.key == ::jaszyk::dependency_resolver_impl::utility::key_of<TBundle>()) {
+                    return;
+                }
+            }
+
+            bind_bundles(static_cast<typename traits::arguments*>(nullptr));
+
+            const std::string name = type_name<TBundle>();
+            add<TBundle, TBundle>(TBundle::dependency_bundle::lifetime, name, name, &traits::dependencies, traits::aggregate, true);
+        }
+
+        const registration& find(const service_key& key, const std::string& name, const registration& consumer) const;
+
+        std::size_t index_of(const dependency& parameter, const registration& consumer) const;
+
+        bool needs_scope(std::size_t index, std::vector<visit_state>& states, std::vector<bool>& scoped) const;
+
+        std::string arguments(const registration& consumer, const std::vector<bool>& scoped) const;
+
+        // expression creating the service of r
+        std::string construction(const registration& r, const std::vector<bool>& scoped) const;
+
+        static std::string identifier(const std::string& name);
+
+        std::vector<std::string> includes_;
+        std::vector<registration> registrations_;
+    };
+
+    inline void manifest::write(std::ostream& out, const std::string& name_space) const {
+        const std::size_t count = registrations_.size();
+
+        std::vector<visit_state> states(count, visit_state::none);
+        std::vector<bool> scoped(count, false);
+        std::vector<bool> primary(count, false);
+        std::vector<const registration*> scope_members;
+
+        for (std::size_t i = 0; i < count; ++i) {
+            const registration& r = registrations_[i];
+
+            if (r.lifetime != service_lifetime::singleton && r.lifetime != service_lifetime::transient && r.lifetime != service_lifetime::scoped) {
+                throw std::runtime_error(r.interface_name + " is neither a singleton, a transient nor a scoped service");
+            }
+
+            needs_scope(i, states, scoped);
+            primary[i] = &find(r.key, r.interface_name, r) == &r;
+
+            if (r.lifetime == service_lifetime::singleton) {
+                for (const auto& parameter : r.dependencies()) {
+                    const std::size_t dependency = index_of(parameter, r);
+
+                    if (scoped[dependency]) {
+                        throw std::runtime_error("Singleton " + r.interface_name + " depends on a scoped service");
+                    }
+
+                    if (registrations_[dependency].lifetime == service_lifetime::singleton && dependency > i) {
+                        throw std::runtime_error("Singleton " + r.interface_name + " depends on a singleton registered after it");
+                    }
+                }
+            }
+
+            if (r.lifetime == service_lifetime::scoped) {
+                bool known = false;
+
+                for (const registration* member : scope_members) {
+                    known = known || member->implementation == r.implementation;
+                }
+
+                if (!known) {
+                    scope_members.push_back(&r);
+                }
+            }
+        }
+
+        out << "// Generated by the dependency_resolver wiring generator. Do not edit.\n";
+        out << "#pragma once\n";
+        out << "#include <memory>\n";
+
+        for (const std::string& header : includes_) {
+            out << "#include \"" << header << "\"\n";
+        }
+
+        const bool aggregates = std::any_of(registrations_.begin(), registrations_.end(),
+            [](const registration& r) { return r.aggregate; });
+
+        // aggregates are brace-initialized with their leading std::shared_ptr fields only
+        if (aggregates) {
+            out << "\n#ifdef __GNUC__\n";
+            out << "#pragma GCC diagnostic push\n";
+            out << "#pragma GCC diagnostic ignored \"-Wmissing-field-initializers\"\n";
+            out << "#endif\n";
+        }
+
+        out << "\nnamespace " << name_space << " {\n\n";
+        out << "    class wiring {\n";
+        out << "    public:\n";
+        out << "        struct scope {\n";
+
+        for (const registration* member : scope_members) {
+            out << "            std::shared_ptr<" << member->service_name << "> " << identifier(member->service_name) << "_;\n";
+        }
+
+        out << "        };\n\n";
+
+        std::string parameters;
+
+        for (const registration& r : registrations_) {
+            if (r.lifetime == service_lifetime::singleton && r.service_name.empty()) {
+                parameters += (parameters.empty() ? "" : ", ");
+                parameters += "std::shared_ptr<" + r.interface_name + "> " + identifier(r.interface_name) + "_instance";
+            }
+        }
+
+        out << "        " << (parameters.empty() ? "" : "explicit ") << "wiring(" << parameters << ") {\n";
+
+        for (std::size_t i = 0; i < count; ++i) {
+            const registration& r = registrations_[i];
+
+            if (!primary[i] || r.lifetime != service_lifetime::singleton) {
+                continue;
+            }
+
+            out << "            singleton_" << identifier(r.interface_name) << "_ = ";
+
+            if (r.service_name.empty()) {
+                out << "std::move(" << identifier(r.interface_name) << "_instance);\n";
+            }
+            else {
+                out << construction(r, scoped) << ";\n";
+            }
+        }
+
+        out << "        }\n";
+
+        for (std::size_t i = 0; i < count; ++i) {
+            const registration& r = registrations_[i];
+            const std::string name = identifier(r.interface_name);
+
+            if (!primary[i]) {
+                continue;
+            }
+
+            out << "\n";
+
+            switch (r.lifetime) {
+            case service_lifetime::singleton:
+                out << "        const std::shared_ptr<" << r.interface_name << ">& resolve_" << name << "() const {\n";
+                out << "            return singleton_" << name << "_;\n";
+                out << "        }\n";
+                break;
+
+            case service_lifetime::transient:
+                out << "        std::shared_ptr<" << r.interface_name << "> resolve_" << name << "(" << (scoped[i] ? "scope& s" : "") << ") const {\n";
+                out << "            return " << construction(r, scoped) << ";\n";
+                out << "        }\n";
+                break;
+
+            case service_lifetime::scoped:
+                out << "        std::shared_ptr<" << r.interface_name << "> resolve_" << name << "(scope& s) const {\n";
+                out << "            if (!s." << identifier(r.service_name) << "_) {\n";
+                out << "                s." << identifier(r.service_name) << "_ = " << construction(r, scoped) << ";\n";
+                out << "            }\n";
+                out << "            return s." << identifier(r.service_name) << "_;\n";
+                out << "        }\n";
+                break;
+
+            // rejected above
+            case service_lifetime::expiring:
+            case service_lifetime::weak_cached:
+                break;
+            }
+        }
+
+        out << "\n    private:\n";
+        out << "        template <typename T>\n";
+        out << "        static std::shared_ptr<T> created(std::shared_ptr<T> service) {\n";
+        out << "            service->on_created();\n";
+        out << "            return service;\n";
+        out << "        }\n\n";
+        out << "        template <typename T>\n";
+        out << "        static void dispose(T* service) {\n";
+        out << "            service->on_disposed();\n";
+        out << "            delete service;\n";
+        out << "        }\n\n";
+
+        for (std::size_t i = 0; i < count; ++i) {
+            const registration& r = registrations_[i];
+
+            if (primary[i] && r.lifetime == service_lifetime::singleton) {
+                out << "        std::shared_ptr<" << r.interface_name << "> singleton_" << identifier(r.interface_name) << "_;\n";
+            }
+        }
+
+        out << "    };\n\n";
+        out << "} // namespace " << name_space << "\n";
+
+        if (aggregates) {
+            out << "\n#ifdef __GNUC__\n";
+            out << "#pragma GCC diagnostic pop\n";
+            out << "#endif\n";
+        }
+    }
+
+    // the first registration of a key wins, as in dependency_resolver; implicit bundles only if there is none
+    inline const manifest::registration& manifest::find(const service_key& key, const std::string& name, const registration& consumer) const {
+        const registration* implicit = nullptr;
+
+        for (const registration& r : registrations_) {
+            if (r.key == key && !r.implicit) {
+                return r;
+            }
+
+            if (r.key == key && implicit == nullptr) {
+                implicit = &r;
+            }
+        }
+
+        if (implicit != nullptr) {
+            return *implicit;
+        }
+
+        throw std::runtime_error("Unregistered dependency of " + consumer.interface_name + ": " + name);
+    }
+
+    inline std::size_t manifest::index_of(const dependency& parameter, const registration& consumer) const {
+        return static_cast<std::size_t>(&find(parameter.key, parameter.name, consumer) - registrations_.data());
+    }
+
+    inline bool manifest::needs_scope(std::size_t index, std::vector<visit_state>& states, std::vector<bool>& scoped) const {
+        if (states[index] == visit_state::visited) {
+            return scoped[index];
+        }
+
+        if (states[index] == visit_state::visiting) {
+            throw std::runtime_error("Circular dependency through " + registrations_[index].interface_name);
+        }
+
+        const registration& r = registrations_[index];
+        bool result = r.lifetime == service_lifetime::scoped;
+
+        if (r.lifetime != service_lifetime::singleton) {
+            states[index] = visit_state::visiting;
+
+            for (const auto& parameter : r.dependencies()) {
+                result = needs_scope(index_of(parameter, r), states, scoped) || result;
+            }
+        }
+
+        states[index] = visit_state::visited;
+        scoped[index] = result;
+
+        return result;
+    }
+
+    inline std::string manifest::arguments(const registration& consumer, const std::vector<bool>& scoped) const {
+        std::string result;
+
+        for (const auto& parameter : consumer.dependencies()) {
+            const std::size_t dependency = index_of(parameter, consumer);
+            const registration& r = registrations_[dependency];
+
+            if (!result.empty()) {
+                result += ", ";
+            }
+
+            if (r.lifetime == service_lifetime::singleton) {
+                result += "singleton_" + identifier(r.interface_name) + "_";
+            }
+            else {
+                result += "resolve_" + identifier(r.interface_name) + (scoped[dependency] ? "(s)" : "()");
+            }
+        }
+
+        return result;
+    }
+
+    // aggregates are brace-initialized in place, make_shared would have to move them;
+    // services with on_disposed() get it called by their deleter
+    inline std::string manifest::construction(const registration& r, const std::vector<bool>& scoped) const {
+        std::string result;
+
+        if (r.aggregate || r.disposing) {
+            result = "std::shared_ptr<" + r.service_name + ">(new " + r.service_name
+                + (r.aggregate ? "{ " + arguments(r, scoped) + " }" : "(" + arguments(r, scoped) + ")")
+                + (r.disposing ? ", &dispose<" + r.service_name + ">)" : ")");
+        }
+        else {
+            result = "std::make_shared<" + r.service_name + ">(" + arguments(r, scoped) + ")";
+        }
+
+        return r.created ? "created(" + result + ")" : result;
+    }
+
+    inline std::string manifest::identifier(const std::string& name) {
+        std::string result;
+
+        for (char c : name) {
+            const bool alnum = (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9');
+            result += alnum ? c : '_';
+        }
+
+        return result;
+    }
+
+} // namespace codegen
+} // inline namespace JASZYK_DEPENDENCY_RESOLVER_ABI
+} // namespace jaszyk
+
+#define JASZYK_DEPENDENCY_MANIFEST(name) \
+    inline void jaszyk_describe_services(::jaszyk::codegen::manifest& name)
+
+#define JASZYK_MANIFEST_SINGLETON(manifest, TInterface, TService) \
+    (manifest).add_singleton<TInterface, TService>(#TInterface, #TService)
+
+#define JASZYK_MANIFEST_INSTANCE(manifest, TInterface) \
+    (manifest).add_instance<TInterface>(#TInterface)
+
+#define JASZYK_MANIFEST_TRANSIENT(manifest, TInterface, TService) \
+    (manifest).add_transient<TInterface, TService>(#TInterface, #TService)
+
+#define JASZYK_MANIFEST_SCOPED(manifest, TInterface, TService) \
+    (manifest).add_scoped<TInterface, TService>(#TInterface, #TService)
+
+#endif // !__JASZYK_DEPENDENCY_RESOLVER_CODEGEN_HPP__
@@ -0,0 +1,44 @@
+#pragma once
+#ifndef __JASZYK_DEPENDENCY_RESOLVER_FWD_HPP__
+#define __JASZYK_DEPENDENCY_RESOLVER_FWD_HPP__
+
+// Inline functions of the resolver differ with JASZYK_DEPENDENCY_RESOLVER_DIAGNOSTICS,
+// so everything is declared in an inline namespace named after it. Translation units
+// built with different settings get distinct entities instead of breaking the
+// one-definition rule, and passing a resolver from one to the other fails to link.
+#ifdef JASZYK_DEPENDENCY_RESOLVER_DIAGNOSTICS
+#define JASZYK_DEPENDENCY_RESOLVER_ABI abi_diagnostics
+#ifdef _MSC_VER
+#pragma detect_mismatch("jaszyk_dependency_resolver_diagnostics", "1")
+#endif
+#else
+#define JASZYK_DEPENDENCY_RESOLVER_ABI abi_standard
+#ifdef _MSC_VER
+#pragma detect_mismatch("jaszyk_dependency_resolver_diagnostics", "0")
+#endif
+#endif
+
+/*
+    Forward declarations of the resolver.
+
+    Services don't need the resolver at all: they take their dependencies as
+    std::shared_ptr, so their headers include only <memory>. Code that merely
+    passes the resolver around - functions registering a group of services,
+    composition roots split over several translation units - can include this
+    header and leave dependency_resolver.hpp to the translation units that
+    register or resolve:
+
+        #include <dependency_resolver_fwd.hpp>
+
+        void register_reporting(jaszyk::dependency_registrar& registrar);
+*/
+
+namespace jaszyk {
+inline namespace JASZYK_DEPENDENCY_RESOLVER_ABI {
+    class dependency_resolver;
+    class dependency_registrar;
+    class concurrent_resolver;
+} // inline namespace JASZYK_DEPENDENCY_RESOLVER_ABI
+} // namespace jaszyk
+
+#endif // !__JASZYK_DEPENDENCY_RESOLVER_FWD_HPP__
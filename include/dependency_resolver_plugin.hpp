@@ -0,0 +1,198 @@
+#pragma once
+#ifndef __JASZYK_DEPENDENCY_RESOLVER_PLUGIN_HPP__
+#define __JASZYK_DEPENDENCY_RESOLVER_PLUGIN_HPP__
+#include "dependency_resolver.hpp"
+#include <string>
+#include <vector>
+#include <stdexcept>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <dlfcn.h>
+#endif
+
+/*
+    Services contributed by shared objects.
+
+    A plugin defines its entry point with JASZYK_DEPENDENCY_PLUGIN and registers
+    its services on the registrar it receives:
+
+        JASZYK_DEPENDENCY_PLUGIN(registrar) {
+            registrar.add_singleton<IExporter, CsvExporter>();
+        }
+
+    The host loads all plugins at startup and merges their registrations in one
+    pass; a sealed resolver is resealed once, not per plugin:
+
+        auto plugins = jaszyk::load_plugins<Application>(resolver, { "libcsv.so", "libxml.so" });
+
+    Factories and singletons of a plugin live in its code, so the returned plugins
+    must outlive the resolver. Services are matched across shared objects by their
+    type ids, which don't depend on RTTI symbols being shared.
+*/
+
+#ifdef _WIN32
+#define JASZYK_DEPENDENCY_PLUGIN_EXPORT extern "C" __declspec(dllexport)
+#else
+#define JASZYK_DEPENDENCY_PLUGIN_EXPORT extern "C" __attribute__((visibility("default")))
+#endif
+
+// the entry point is extern "C", so its name carries the ABI tag: a plugin built with
+// different JASZYK_DEPENDENCY_RESOLVER_DIAGNOSTICS than the host fails to load
+#define JASZYK_DEPENDENCY_PLUGIN_CONCAT_(a, b) a##b
+#define JASZYK_DEPENDENCY_PLUGIN_CONCAT(a, b) JASZYK_DEPENDENCY_PLUGIN_CONCAT_(a, b)
+#define JASZYK_DEPENDENCY_PLUGIN_STRING_(a) #a
+#define JASZYK_DEPENDENCY_PLUGIN_STRING(a) JASZYK_DEPENDENCY_PLUGIN_STRING_(a)
+#define JASZYK_DEPENDENCY_PLUGIN_REGISTER \
+    JASZYK_DEPENDENCY_PLUGIN_CONCAT(jaszyk_dependency_plugin_register_, JASZYK_DEPENDENCY_RESOLVER_ABI)
+#define JASZYK_DEPENDENCY_PLUGIN_ENTRY_POINT JASZYK_DEPENDENCY_PLUGIN_STRING(JASZYK_DEPENDENCY_PLUGIN_REGISTER)
+
+#define JASZYK_DEPENDENCY_PLUGIN(registrar) \
+    JASZYK_DEPENDENCY_PLUGIN_EXPORT void JASZYK_DEPENDENCY_PLUGIN_REGISTER(::jaszyk::dependency_registrar& registrar)
+
+namespace jaszyk {
+inline namespace JASZYK_DEPENDENCY_RESOLVER_ABI {
+
+    class plugin_load_exception : public std::runtime_error {
+    public:
+        inline explicit plugin_load_exception(const std::string& message)
+            : std::runtime_error(message) { }
+    };
+
+    // loaded shared object exporting JASZYK_DEPENDENCY_PLUGIN
+    class plugin {
+    public:
+        using entry_point = void(*)(dependency_resolver::registrar&);
+
+        inline explicit plugin(const std::string& path)
+            : path_(path)
+        {
+#ifdef _WIN32
+            handle_ = ::LoadLibraryA(path.c_str());
+#else
+            handle_ = ::dlopen(path.c_str(), RTLD_NOW | RTLD_LOCAL);
+#endif
+            if (handle_ == nullptr) {
+                throw plugin_load_exception("Cannot load plugin " + path + ": " + last_error());
+            }
+
+#ifdef _WIN32
+            register_ = reinterpret_cast<entry_point>(::GetProcAddress(handle_, JASZYK_DEPENDENCY_PLUGIN_ENTRY_POINT));
+#else
+            register_ = reinterpret_cast<entry_point>(::dlsym(handle_, JASZYK_DEPENDENCY_PLUGIN_ENTRY_POINT));
+#endif
+            if (register_ == nullptr) {
+                close();
+                throw plugin_load_exception("Plugin " + path + " has no " JASZYK_DEPENDENCY_PLUGIN_ENTRY_POINT " entry point.");
+            }
+        }
+
+        plugin(const plugin& other) = delete;
+
+        inline plugin(plugin&& other) noexcept
+            : path_(std::move(other.path_)), handle_(other.handle_), register_(other.register_)
+        {
+            other.handle_ = nullptr;
+        }
+
+        plugin& operator=(const plugin& other) = delete;
+
+        inline plugin& operator=(plugin&& other) noexcept {
+            if (this != &other) {
+                close();
+                path_ = std::move(other.path_);
+                handle_ = other.handle_;
+                register_ = other.register_;
+                other.handle_ = nullptr;
+            }
+
+            return *this;
+        }
+
+        inline ~plugin() {
+            close();
+        }
+
+        inline void register_services(dependency_resolver::registrar& registrar) const {
+            register_(registrar);
+        }
+
+        inline const std::string& path() const {
+            return path_;
+        }
+
+        // keeps the shared object loaded after the plugin is destroyed
+        inline void detach() {
+            handle_ = nullptr;
+        }
+
+    private:
+#ifdef _WIN32
+        using handle_type = HMODULE;
+#else
+        using handle_type = void*;
+#endif
+
+        static inline std::string last_error() {
+#ifdef _WIN32
+            return "error " + std::to_string(::GetLastError());
+#else
+            const char* error = ::dlerror();
+            return error != nullptr ? error : "unknown error";
+#endif
+        }
+
+        inline void close() {
+            if (handle_ != nullptr) {
+#ifdef _WIN32
+                ::FreeLibrary(handle_);
+#else
+                ::dlclose(handle_);
+#endif
+                handle_ = nullptr;
+            }
+        }
+
+        std::string path_;
+        handle_type handle_ = nullptr;
+        entry_point register_ = nullptr;
+    };
+
+    // Loads every plugin first, so that a missing one leaves the resolver untouched,
+    // then merges all of their registrations with dependency_resolver::extend.
+    template <typename... TRoots>
+    inline std::vector<plugin> load_plugins(dependency_resolver& resolver, const std::vector<std::string>& paths) {
+        std::vector<plugin> plugins;
+        plugins.reserve(paths.size());
+
+        for (const std::string& path : paths) {
+            plugins.emplace_back(path);
+        }
+
+        std::vector<std::function<void(dependency_resolver::registrar&)>> contributions;
+
+        for (const plugin& loaded : plugins) {
+            contributions.push_back([&loaded](dependency_resolver::registrar& registrar) {
+                loaded.register_services(registrar);
+            });
+        }
+
+        try {
+            resolver.extend<TRoots...>(contributions);
+        }
+        catch (...) {
+            // registrations made before the failure refer to the plugins' code
+            for (plugin& loaded : plugins) {
+                loaded.detach();
+            }
+            throw;
+        }
+
+        return plugins;
+    }
+
+} // inline namespace JASZYK_DEPENDENCY_RESOLVER_ABI
+} // namespace jaszyk
+
+#endif // !__JASZYK_DEPENDENCY_RESOLVER_PLUGIN_HPP__
@@ -0,0 +1,42 @@
+/*
+    Experimental C++20 named module over dependency_resolver.hpp, see README.md.
+
+        import jaszyk.dependency_resolver;
+
+    The header is parsed once, when the module interface is built; importers only
+    load its compiled form. The header stays the single source of truth: the
+    standard headers it uses go to the global module fragment, the header itself
+    is attached to the module and exported as a whole.
+
+    Macros do not cross module boundaries, so JASZYK_OPEN_GENERIC and the plugin
+    macros still need #include <dependency_resolver.hpp>. Standard library names
+    are not re-exported either; include or import them before this module.
+*/
+module;
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <set>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <tuple>
+#include <type_traits>
+#include <typeinfo>
+#include <utility>
+#include <vector>
+
+export module jaszyk.dependency_resolver;
+
+export extern "C++" {
+#include <dependency_resolver.hpp>
+}
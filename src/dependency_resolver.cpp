@@ -0,0 +1,18 @@
+#ifndef JASZYK_DEPENDENCY_RESOLVER_SEPARATE_COMPILATION
+#error "The dependency_resolver library must be built with JASZYK_DEPENDENCY_RESOLVER_SEPARATE_COMPILATION."
+#endif
+
+#include <dependency_resolver.hpp>
+#include <dependency_resolver.ipp>
+
+namespace jaszyk {
+inline namespace JASZYK_DEPENDENCY_RESOLVER_ABI {
+namespace dependency_resolver_impl {
+namespace utility {
+
+    template class perfect_hash_map<const resolution_tape*>;
+
+} // namespace utility
+} // namespace dependency_resolver_impl
+} // inline namespace JASZYK_DEPENDENCY_RESOLVER_ABI
+} // namespace jaszyk
@@ -1,5 +1,10 @@
 #include <gtest/gtest.h>
 #include <dependency_resolver.hpp>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <thread>
 
 using jaszyk::dependency_resolver;
 
@@ -196,6 +201,1328 @@ TEST_F(DependencyResolverTest, TestComplexDependencies) {
     ASSERT_EQ(c4->get_value(), 152);
 }
 
+template <int N>
+class ChainLink {
+    std::shared_ptr<ChainLink<N - 1>> next_;
+public:
+    ChainLink(std::shared_ptr<ChainLink<N - 1>> next)
+        : next_(next)
+    { }
+
+    int length() const {
+        return next_->length() + 1;
+    }
+};
+
+template <>
+class ChainLink<0> {
+public:
+    ChainLink() = default;
+
+    int length() const {
+        return 0;
+    }
+};
+
+template <int... Ns>
+void add_chain(dependency_resolver& resolver, std::integer_sequence<int, Ns...>) {
+    int expand[] = { (resolver.add_transient<ChainLink<Ns>>(), 0)... };
+    (void)expand;
+}
+
+TEST_F(DependencyResolverTest, TestDeepDependencyChain) {
+    add_chain(resolver, std::make_integer_sequence<int, 256>{});
+
+    auto last = resolver.resolve<ChainLink<256>>();
+    ASSERT_EQ(last->length(), 256);
+}
+
+class CycleB;
+
+class CycleA {
+public:
+    CycleA(std::shared_ptr<CycleB>) { }
+};
+
+class CycleB {
+public:
+    CycleB(std::shared_ptr<CycleA>) { }
+};
+
+TEST_F(DependencyResolverTest, TestCircularDependency) {
+    resolver.add_transient<CycleA>();
+    resolver.add_scoped<CycleB>();
+
+    auto scope = resolver.make_scope();
+
+    ASSERT_THROW(resolver.resolve<CycleA>(scope), dependency_resolver::circular_dependency_exception);
+    ASSERT_THROW(resolver.resolve<CycleB>(scope), dependency_resolver::circular_dependency_exception);
+}
+
+TEST_F(DependencyResolverTest, TestMissingDependencies) {
+    resolver.add_scoped<BaseClass, DerivedClass>();
+
+    ASSERT_THROW(resolver.resolve<Controller>(), dependency_resolver::dependency_not_found_exception);
+
+    resolver.add_singleton(5);
+
+    ASSERT_THROW(resolver.resolve<Controller>(), dependency_resolver::missing_scope_exception);
+    ASSERT_EQ(resolver.resolve<Controller>(dependency_resolver::temporary_scope{})->get_value(), 5);
+}
+
+TEST_F(DependencyResolverTest, TestSealedResolver) {
+    resolver.add_singleton(std::string("Hello World"));
+    resolver.add_singleton(150);
+    resolver.add_scoped<BaseClass, DerivedClass>();
+    resolver.add_transient<BaseService2, DerivedService2>();
+
+    resolver.seal<Controller2>();
+    ASSERT_TRUE(resolver.sealed());
+
+    auto scope = resolver.make_scope();
+
+    auto c1 = resolver.resolve<Controller2>(scope);
+    c1->increment();
+
+    auto c2 = resolver.resolve<Controller2>(scope);
+    ASSERT_EQ(c2->get_value(), 151);
+    ASSERT_EQ(c2->get_text(), std::string("Hello World"));
+
+    ASSERT_EQ(resolver.resolve<Controller>(scope)->get_value(), 151);
+    ASSERT_THROW(resolver.resolve<Controller2>(), dependency_resolver::missing_scope_exception);
+
+    resolver.add_transient<Controller>();
+    ASSERT_TRUE(resolver.sealed());
+    ASSERT_EQ(resolver.resolve<Controller2>(scope)->get_value(), 151);
+}
+
+class IReader {
+public:
+    virtual ~IReader() = default;
+    virtual int read() = 0;
+};
+
+class IWriter {
+public:
+    virtual ~IWriter() = default;
+    virtual void write(int value) = 0;
+};
+
+class Buffer : public IReader, public IWriter {
+    int value_ = 0;
+public:
+    static int constructed;
+
+    Buffer() {
+        ++constructed;
+    }
+
+    int read() override {
+        return value_;
+    }
+
+    void write(int value) override {
+        value_ = value;
+    }
+};
+
+int Buffer::constructed = 0;
+
+class BufferUser {
+public:
+    std::shared_ptr<IReader> reader;
+    std::shared_ptr<IWriter> writer;
+
+    BufferUser(std::shared_ptr<IReader> reader, std::shared_ptr<IWriter> writer)
+        : reader(reader)
+        , writer(writer)
+    { }
+};
+
+TEST_F(DependencyResolverTest, TestSingletonExposedAsInterfaces) {
+    Buffer::constructed = 0;
+
+    auto buffer = resolver.add_singleton<Buffer>().as<IReader, IWriter>().instance();
+
+    ASSERT_EQ(Buffer::constructed, 1);
+    ASSERT_EQ(resolver.size(), 3u);
+
+    auto user = resolver.resolve<BufferUser>();
+    user->writer->write(42);
+
+    ASSERT_EQ(resolver.resolve<BufferUser>()->reader->read(), 42);
+    ASSERT_EQ(dynamic_cast<Buffer*>(user->reader.get()), buffer.get());
+    ASSERT_EQ(dynamic_cast<Buffer*>(user->writer.get()), buffer.get());
+    ASSERT_EQ(Buffer::constructed, 1);
+}
+
+template <typename TEntity>
+class IRepository {
+public:
+    virtual ~IRepository() = default;
+    virtual std::string describe() const = 0;
+};
+
+template <typename TEntity>
+class Repository : public IRepository<TEntity> {
+    std::shared_ptr<std::string> connection_;
+public:
+    Repository(std::shared_ptr<std::string> connection)
+        : connection_(connection)
+    { }
+
+    std::string describe() const override {
+        return *connection_ + ":" + TEntity::name();
+    }
+};
+
+struct User {
+    static std::string name() {
+        return "user";
+    }
+};
+
+struct Order {
+    static std::string name() {
+        return "order";
+    }
+};
+
+JASZYK_OPEN_GENERIC(IRepository, Repository)
+
+class OrderService {
+public:
+    std::shared_ptr<IRepository<User>> users;
+    std::shared_ptr<IRepository<Order>> orders;
+
+    OrderService(std::shared_ptr<IRepository<User>> users, std::shared_ptr<IRepository<Order>> orders)
+        : users(users)
+        , orders(orders)
+    { }
+};
+
+TEST_F(DependencyResolverTest, TestOpenGenericRegistration) {
+    resolver.add_singleton(std::string("db"));
+    resolver.add_scoped_template<IRepository, Repository>();
+
+    ASSERT_EQ(resolver.size(), 1u);
+
+    auto scope = resolver.make_scope();
+    auto first = resolver.resolve<OrderService>(scope);
+
+    ASSERT_EQ(resolver.size(), 3u);
+    ASSERT_EQ(first->users->describe(), "db:user");
+    ASSERT_EQ(first->orders->describe(), "db:order");
+
+    auto second = resolver.resolve<OrderService>(scope);
+    ASSERT_EQ(first->users, second->users);
+    ASSERT_EQ(resolver.size(), 3u);
+
+    auto other_scope = resolver.make_scope();
+    ASSERT_NE(resolver.resolve<OrderService>(other_scope)->users, first->users);
+}
+
+class IReporting {
+public:
+    virtual ~IReporting() = default;
+    virtual std::string report() = 0;
+};
+
+class Reporting : public IReporting {
+    std::shared_ptr<std::string> title_;
+public:
+    static int constructed;
+
+    Reporting(std::shared_ptr<std::string> title)
+        : title_(title)
+    {
+        ++constructed;
+    }
+
+    std::string report() override {
+        return "report: " + *title_;
+    }
+};
+
+int Reporting::constructed = 0;
+
+class ReportController {
+    std::shared_ptr<IReporting> reporting_;
+public:
+    ReportController(std::shared_ptr<IReporting> reporting)
+        : reporting_(reporting)
+    { }
+
+    std::string run() {
+        return reporting_->report();
+    }
+};
+
+TEST_F(DependencyResolverTest, TestLazyModule) {
+    Reporting::constructed = 0;
+    int configured = 0;
+
+    resolver.add_singleton(std::string("sales"));
+    resolver.add_module<IReporting>([&configured](dependency_resolver::registrar& registrar) {
+        ++configured;
+        registrar.add_singleton<IReporting, Reporting>();
+    });
+
+    ASSERT_EQ(configured, 0);
+    ASSERT_EQ(Reporting::constructed, 0);
+    ASSERT_EQ(resolver.size(), 1u);
+
+    ASSERT_EQ(resolver.resolve<ReportController>()->run(), "report: sales");
+    ASSERT_EQ(resolver.resolve<ReportController>()->run(), "report: sales");
+
+    ASSERT_EQ(configured, 1);
+    ASSERT_EQ(Reporting::constructed, 1);
+    ASSERT_EQ(resolver.size(), 2u);
+}
+
+TEST_F(DependencyResolverTest, TestLazyModuleRegistrationPolicy) {
+    const auto collide = [](dependency_resolver::registration_policy policy) {
+        dependency_resolver modular;
+        modular.set_registration_policy(policy);
+        modular.add_singleton(std::string("sales"));
+        modular.add_module<IReporting>([](dependency_resolver::registrar& registrar) {
+            registrar.add_singleton(std::string("hr"));
+            registrar.add_singleton<IReporting, Reporting>();
+        });
+
+        return modular.resolve<ReportController>()->run();
+    };
+
+    ASSERT_EQ(collide(dependency_resolver::registration_policy::keep_first), "report: sales");
+    ASSERT_THROW(collide(dependency_resolver::registration_policy::error), dependency_resolver::duplicate_registration_exception);
+
+    // the tape being compiled may have read the binding a module would replace
+    ASSERT_THROW(collide(dependency_resolver::registration_policy::replace), dependency_resolver::duplicate_registration_exception);
+    ASSERT_THROW(collide(dependency_resolver::registration_policy::append), dependency_resolver::duplicate_registration_exception);
+}
+
+class IFeatureFlags {
+public:
+    virtual ~IFeatureFlags() = default;
+    virtual int version() const = 0;
+};
+
+template <int N>
+class FeatureFlags : public IFeatureFlags {
+public:
+    int version() const override {
+        return N;
+    }
+};
+
+class FlagsConsumer {
+public:
+    std::shared_ptr<IFeatureFlags> flags;
+    std::shared_ptr<int> counter;
+
+    FlagsConsumer(std::shared_ptr<IFeatureFlags> flags, std::shared_ptr<int> counter)
+        : flags(flags)
+        , counter(counter)
+    { }
+};
+
+TEST_F(DependencyResolverTest, TestConcurrentRebinding) {
+    resolver.add_singleton(7);
+    resolver.add_transient<IFeatureFlags, FeatureFlags<1>>();
+
+    jaszyk::concurrent_resolver concurrent(std::move(resolver));
+    ASSERT_TRUE(concurrent.sealed());
+    concurrent.resolve<FlagsConsumer>();
+
+    std::atomic<bool> stop{ false };
+    std::atomic<int> failures{ 0 };
+    std::vector<std::thread> readers;
+
+    for (int i = 0; i < 4; ++i) {
+        readers.emplace_back([&] {
+            int last = 1;
+
+            while (!stop.load()) {
+                auto consumer = concurrent.resolve<FlagsConsumer>();
+                const int version = consumer->flags->version();
+
+                if (version < last || *consumer->counter != 7) {
+                    ++failures;
+                }
+
+                last = version;
+            }
+        });
+    }
+
+    // every published version is sealed with the roots resolved from the previous one
+    concurrent.rebind<IFeatureFlags>([](dependency_resolver& next) {
+        next.add_transient<IFeatureFlags, FeatureFlags<2>>();
+    });
+    ASSERT_TRUE(concurrent.sealed());
+    ASSERT_TRUE(concurrent.prepared<FlagsConsumer>());
+
+    concurrent.rebind<IFeatureFlags>([](dependency_resolver& next) {
+        next.add_singleton<IFeatureFlags, FeatureFlags<3>>();
+    });
+    ASSERT_TRUE(concurrent.sealed());
+    ASSERT_TRUE(concurrent.prepared<FlagsConsumer>());
+
+    stop = true;
+
+    for (auto& reader : readers) {
+        reader.join();
+    }
+
+    ASSERT_EQ(failures.load(), 0);
+    ASSERT_EQ(concurrent.version(), 2u);
+    ASSERT_EQ(concurrent.resolve<FlagsConsumer>()->flags->version(), 3);
+}
+
+TEST_F(DependencyResolverTest, TestConcurrentPublishScopeLayout) {
+    resolver.add_scoped<IFeatureFlags, FeatureFlags<1>>();
+    resolver.add_scoped<int>();
+    resolver.add_scoped<BaseClass, DerivedClass>();
+
+    jaszyk::concurrent_resolver concurrent(std::move(resolver));
+    jaszyk::concurrent_resolver::scope scope;
+
+    auto flags = concurrent.resolve<FlagsConsumer>(scope)->flags;
+    auto first = concurrent.resolve<Controller>(scope);
+    first->increment();
+
+    // built independently, so its scoped services have other slots
+    dependency_resolver next;
+    next.add_scoped<BaseClass, DerivedClass>();
+    next.add_scoped<int>();
+    concurrent.publish(std::move(next));
+
+    auto second = concurrent.resolve<Controller>(scope);
+    ASSERT_EQ(second->get_value(), 1);
+    second->increment();
+    ASSERT_EQ(concurrent.resolve<Controller>(scope)->get_value(), 2);
+
+    // instances the new version has no slot for live as long as the scope
+    ASSERT_EQ(flags.use_count(), 2);
+
+    jaszyk::concurrent_resolver::scope other;
+    ASSERT_EQ(concurrent.resolve<Controller>(other)->get_value(), 0);
+}
+
+
+TEST_F(DependencyResolverTest, TestIncrementalInvalidation) {
+    resolver.add_singleton(7);
+    resolver.add_transient<IFeatureFlags, FeatureFlags<1>>();
+    resolver.add_transient<BaseClass, DerivedClass>();
+
+    resolver.seal<FlagsConsumer, Controller>();
+    ASSERT_EQ(resolver.resolve<FlagsConsumer>()->flags->version(), 1);
+
+    // first registration wins
+    resolver.add_transient<IFeatureFlags, FeatureFlags<2>>();
+    ASSERT_TRUE(resolver.prepared<FlagsConsumer>());
+    ASSERT_EQ(resolver.resolve<FlagsConsumer>()->flags->version(), 1);
+
+    resolver.set_registration_policy(dependency_resolver::registration_policy::replace);
+    resolver.add_transient<IFeatureFlags, FeatureFlags<3>>();
+
+    ASSERT_TRUE(resolver.sealed());
+    ASSERT_FALSE(resolver.prepared<FlagsConsumer>());
+    ASSERT_TRUE(resolver.prepared<Controller>());
+
+    ASSERT_EQ(resolver.resolve<FlagsConsumer>()->flags->version(), 3);
+    ASSERT_EQ(resolver.resolve<Controller>()->get_value(), 7);
+    ASSERT_TRUE(resolver.prepared<FlagsConsumer>());
+}
+
+TEST_F(DependencyResolverTest, TestRegistrationPolicies) {
+    using policy = dependency_resolver::registration_policy;
+
+    resolver.set_registration_policy(policy::error);
+    resolver.add_transient<IFeatureFlags, FeatureFlags<1>>();
+    ASSERT_THROW((resolver.add_transient<IFeatureFlags, FeatureFlags<2>>()), dependency_resolver::duplicate_registration_exception);
+
+    resolver.set_registration_policy(policy::append);
+    resolver.add_transient<IFeatureFlags, FeatureFlags<2>>();
+    resolver.add_singleton<IFeatureFlags, FeatureFlags<3>>();
+
+    auto all = resolver.resolve_all<IFeatureFlags>();
+    ASSERT_EQ(all.size(), 3u);
+    ASSERT_EQ(all[0]->version(), 1);
+    ASSERT_EQ(all[1]->version(), 2);
+    ASSERT_EQ(all[2]->version(), 3);
+    resolver.add_singleton(7);
+    ASSERT_EQ(resolver.resolve<FlagsConsumer>()->flags->version(), 3);
+
+    resolver.set_registration_policy(policy::replace);
+    resolver.add_transient<IFeatureFlags, FeatureFlags<4>>();
+    ASSERT_EQ(resolver.resolve_all<IFeatureFlags>().size(), 3u);
+    ASSERT_EQ(resolver.resolve_all<IFeatureFlags>()[2]->version(), 4);
+    ASSERT_TRUE(resolver.resolve_all<BaseClass>().empty());
+}
+
+TEST_F(DependencyResolverTest, TestRemoveAndCompaction) {
+    resolver.set_registration_policy(dependency_resolver::registration_policy::replace);
+    resolver.add_singleton(7);
+    resolver.add_scoped<BaseClass, DerivedClass>();
+    resolver.add_transient<IFeatureFlags, FeatureFlags<1>>();
+
+    resolver.seal<Controller>();
+    auto scope = resolver.make_scope();
+    resolver.resolve<Controller>(scope)->increment();
+
+    // rebinding over and over compacts the table under the sealed tape of Controller
+    for (int i = 0; i < 16; ++i) {
+        resolver.add_transient<IFeatureFlags, FeatureFlags<2>>();
+        ASSERT_EQ(resolver.resolve<FlagsConsumer>()->flags->version(), 2);
+    }
+
+    ASSERT_TRUE(resolver.prepared<Controller>());
+    ASSERT_EQ(resolver.resolve<Controller>(scope)->get_value(), 8);
+
+    ASSERT_TRUE(resolver.remove<IFeatureFlags>());
+    ASSERT_FALSE(resolver.remove<IFeatureFlags>());
+    ASSERT_EQ(resolver.size(), 2u);
+    ASSERT_THROW(resolver.resolve<FlagsConsumer>(), dependency_resolver::dependency_not_found_exception);
+
+    resolver.compact();
+    ASSERT_EQ(resolver.resolve<Controller>(scope)->get_value(), 8);
+}
+
+TEST_F(DependencyResolverTest, TestMemoryStats) {
+    resolver.add_singleton(7);
+    resolver.add_singleton<Buffer>().as<IReader, IWriter>();
+    resolver.add_scoped<BaseClass, DerivedClass>();
+
+    auto empty = resolver.memory_stats();
+    ASSERT_EQ(empty.services, 5u);
+    ASSERT_EQ(empty.singletons, 2u);
+    ASSERT_GE(empty.singleton_bytes, sizeof(int) + sizeof(Buffer));
+    ASSERT_EQ(empty.tapes, 1u); // Buffer was resolved to be registered
+
+    auto scope = resolver.make_scope();
+    resolver.resolve<Controller>(scope);
+
+    auto stats = resolver.memory_stats(scope);
+    ASSERT_EQ(stats.tapes, 2u);
+    ASSERT_GT(stats.tape_bytes, 0u);
+    ASSERT_EQ(stats.scoped_instances, 1u);
+    ASSERT_GE(stats.scope_bytes, sizeof(DerivedClass));
+    ASSERT_EQ(stats.registry_bytes, empty.registry_bytes);
+    ASSERT_GT(stats.total_bytes(), empty.total_bytes());
+}
+
+TEST_F(DependencyResolverTest, TestDuplicateRegistrationNamesService) {
+    resolver.set_registration_policy(dependency_resolver::registration_policy::error);
+    resolver.add_transient<IFeatureFlags, FeatureFlags<1>>();
+
+    try {
+        resolver.add_transient<IFeatureFlags, FeatureFlags<2>>();
+        FAIL();
+    }
+    catch (const dependency_resolver::duplicate_registration_exception& e) {
+        ASSERT_NE(std::string(e.what()).find(typeid(FeatureFlags<1>).name()), std::string::npos);
+    }
+}
+
+template <std::size_t N>
+struct HashKey { };
+
+template <std::size_t... Ns>
+std::vector<std::pair<jaszyk::dependency_resolver_impl::utility::service_key, std::size_t>> hash_keys(std::index_sequence<Ns...>) {
+    return { { jaszyk::dependency_resolver_impl::utility::type_id_of<HashKey<Ns>>(), Ns }... };
+}
+
+TEST_F(DependencyResolverTest, TestPerfectHashLookup) {
+    auto keys = hash_keys(std::make_index_sequence<512>{});
+
+    jaszyk::dependency_resolver_impl::utility::perfect_hash_map<std::size_t> index;
+    ASSERT_TRUE(index.build(keys));
+
+    for (const auto& key : keys) {
+        ASSERT_NE(index.find(key.first), nullptr);
+        ASSERT_EQ(*index.find(key.first), key.second);
+    }
+
+    using jaszyk::dependency_resolver_impl::utility::type_id_of;
+
+    ASSERT_EQ(index.find(type_id_of<int>()), nullptr);
+
+    index.erase(type_id_of<HashKey<7>>());
+    ASSERT_EQ(index.find(type_id_of<HashKey<7>>()), nullptr);
+    ASSERT_EQ(*index.find(type_id_of<HashKey<8>>()), 8u);
+}
+
+TEST_F(DependencyResolverTest, TestSealedLookupAfterRebind) {
+    resolver.add_singleton(7);
+    resolver.add_transient<IFeatureFlags, FeatureFlags<1>>();
+    resolver.add_transient<BaseClass, DerivedClass>();
+    add_chain(resolver, std::make_integer_sequence<int, 8>{});
+
+    resolver.seal<FlagsConsumer, Controller, ChainLink<8>>();
+    ASSERT_EQ(resolver.resolve<Controller>()->get_value(), 7);
+
+    resolver.set_registration_policy(dependency_resolver::registration_policy::replace);
+    resolver.add_transient<IFeatureFlags, FeatureFlags<2>>();
+
+    ASSERT_EQ(resolver.resolve<FlagsConsumer>()->flags->version(), 2);
+    ASSERT_EQ(resolver.resolve<ChainLink<8>>()->length(), 8);
+}
+
+TEST_F(DependencyResolverTest, TestStableTypeIds) {
+    using namespace jaszyk::dependency_resolver_impl::utility;
+
+    static_assert(type_hash<User>() != type_hash<Order>(), "Distinct types must have distinct ids.");
+    static_assert(type_hash<IRepository<User>>() != type_hash<IRepository<Order>>(), "Distinct types must have distinct ids.");
+
+    ASSERT_EQ(key_of<BaseClass>(), key_of<BaseClass>());
+    ASSERT_NE(key_of<BaseClass>(), key_of<DerivedClass>());
+    ASSERT_NE(key_of<BaseClass>(), type_id_of<BaseClass>());
+
+    // the value depends only on the spelling of the type, not on the address of its RTTI
+    ASSERT_EQ(type_id_of<Order>().value(), type_hash<Order>());
+}
+
+class Clock {
+public:
+    using injection_constructor = dependency_resolver::inject<std::shared_ptr<int>>;
+
+    Clock() : start(0) { }
+    explicit Clock(std::shared_ptr<int> start) : start(*start) { }
+
+    int start;
+};
+
+// both constructors take one pointer, the probe can't tell them apart
+class Stopwatch {
+public:
+    Stopwatch() : clock(nullptr), lap(0) { }
+    explicit Stopwatch(std::shared_ptr<Clock> clock) : clock(clock), lap(0) { }
+    explicit Stopwatch(std::shared_ptr<IFeatureFlags> flags) : clock(nullptr), lap(flags->version()) { }
+
+    std::shared_ptr<Clock> clock;
+    int lap;
+};
+
+JASZYK_INJECTION_CONSTRUCTOR(Stopwatch, std::shared_ptr<Clock>)
+
+TEST_F(DependencyResolverTest, TestInjectionConstructor) {
+    using jaszyk::dependency_resolver_impl::utility::constructor_traits;
+
+    static_assert(constructor_traits<Clock>::arity == 1, "The declared constructor must be used.");
+    static_assert(constructor_traits<Stopwatch>::arity == 1, "The declared constructor must be used.");
+
+    resolver.add_singleton(7);
+    resolver.add_transient<IFeatureFlags, FeatureFlags<1>>();
+
+    ASSERT_EQ(resolver.resolve<Clock>()->start, 7);
+
+    resolver.add_singleton<Clock>();
+    auto stopwatch = resolver.resolve<Stopwatch>();
+    ASSERT_NE(stopwatch->clock, nullptr);
+    ASSERT_EQ(stopwatch->clock->start, 7);
+    ASSERT_EQ(stopwatch->lap, 0);
+}
+
+struct FlagsBundle {
+    std::shared_ptr<int> value;
+    std::shared_ptr<IFeatureFlags> flags;
+};
+
+struct RetrySettings {
+    int retries = 3;
+    std::string name = "retry";
+};
+
+struct MisplacedDependency {
+    int retries = 3;
+    std::shared_ptr<int> value;
+};
+
+struct RetryPolicy {
+    std::shared_ptr<int> value;
+    int retries = 3;
+    std::mutex mutex;
+};
+
+// built with its dependency rather than value-initialized, the counter left to its braces
+struct RetryCounter {
+    std::shared_ptr<int> value;
+    int attempts;
+};
+
+TEST_F(DependencyResolverTest, TestAggregateInjection) {
+    using jaszyk::dependency_resolver_impl::utility::constructor_traits;
+
+    static_assert(constructor_traits<FlagsBundle>::aggregate, "Aggregates of pointers are brace-initialized.");
+    static_assert(constructor_traits<FlagsBundle>::arity == 2, "Every field is a dependency.");
+    static_assert(!constructor_traits<RetrySettings>::aggregate, "Aggregates without leading pointers are value-initialized.");
+    static_assert(constructor_traits<RetryPolicy>::arity == 1, "Only the leading pointers are dependencies.");
+    static_assert(constructor_traits<RetryCounter>::aggregate && constructor_traits<RetryCounter>::arity == 1,
+        "Aggregates with a leading pointer and other fields are brace-initialized.");
+    static_assert(jaszyk::dependency_resolver_impl::utility::reflections::has_trailing_shared_field<MisplacedDependency>(),
+        "A pointer after another field is detected.");
+
+    ASSERT_THROW(resolver.resolve<RetryCounter>(), dependency_resolver::dependency_not_found_exception);
+
+    resolver.add_singleton(7);
+    resolver.add_transient<IFeatureFlags, FeatureFlags<2>>();
+
+    auto bundle = resolver.resolve<FlagsBundle>();
+    ASSERT_EQ(*bundle->value, 7);
+    ASSERT_EQ(bundle->flags->version(), 2);
+
+    auto settings = resolver.resolve<RetrySettings>();
+    ASSERT_EQ(settings->retries, 3);
+    ASSERT_EQ(settings->name, "retry");
+
+    auto policy = resolver.resolve<RetryPolicy>();
+    ASSERT_EQ(*policy->value, 7);
+    ASSERT_EQ(policy->retries, 3);
+
+    auto counter = resolver.resolve<RetryCounter>();
+    ASSERT_EQ(*counter->value, 7);
+    ASSERT_EQ(counter->attempts, 0);
+}
+
+struct ConsumerServices {
+    using dependency_bundle = dependency_resolver::scoped_bundle;
+
+    std::shared_ptr<int> value;
+    std::shared_ptr<IFeatureFlags> flags;
+};
+
+struct RequestServices {
+    using dependency_bundle = dependency_resolver::transient_bundle;
+
+    std::shared_ptr<int> value;
+};
+
+class BundledConsumer {
+public:
+    BundledConsumer(std::shared_ptr<ConsumerServices> services, std::shared_ptr<RequestServices> request)
+        : services(services)
+        , request(request)
+    { }
+
+    std::shared_ptr<ConsumerServices> services;
+    std::shared_ptr<RequestServices> request;
+};
+
+TEST_F(DependencyResolverTest, TestDependencyBundles) {
+    resolver.add_singleton(7);
+    resolver.add_transient<IFeatureFlags, FeatureFlags<2>>();
+
+    auto scope = resolver.make_scope();
+    auto first = resolver.resolve<BundledConsumer>(scope);
+    auto second = resolver.resolve<BundledConsumer>(scope);
+
+    ASSERT_EQ(*first->services->value, 7);
+    ASSERT_EQ(first->services->flags->version(), 2);
+    ASSERT_EQ(first->services, second->services);
+    ASSERT_NE(first->request, second->request);
+    ASSERT_EQ(first->request->value, first->services->value);
+
+    auto other = resolver.make_scope();
+    ASSERT_NE(resolver.resolve<BundledConsumer>(other)->services, first->services);
+
+    ASSERT_THROW(resolver.resolve<BundledConsumer>(), dependency_resolver::missing_scope_exception);
+}
+
+template <int Offset>
+class VersionOffset : public IFeatureFlags {
+public:
+    explicit VersionOffset(std::shared_ptr<IFeatureFlags> inner) : inner(inner) { }
+
+    int version() const override {
+        return inner->version() + Offset;
+    }
+
+    std::shared_ptr<IFeatureFlags> inner;
+};
+
+class ScaledVersion : public IFeatureFlags {
+public:
+    ScaledVersion(std::shared_ptr<int> factor, std::shared_ptr<IFeatureFlags> inner) : factor(factor), inner(inner) { }
+
+    int version() const override {
+        return inner->version() * *factor;
+    }
+
+    std::shared_ptr<int> factor;
+    std::shared_ptr<IFeatureFlags> inner;
+};
+
+TEST_F(DependencyResolverTest, TestDecorators) {
+    resolver.add_singleton(10);
+    resolver.add_transient<IFeatureFlags, FeatureFlags<2>>();
+    resolver.seal<FlagsConsumer>();
+    ASSERT_EQ(resolver.resolve<FlagsConsumer>()->flags->version(), 2);
+
+    resolver.decorate<IFeatureFlags, VersionOffset<1>>();
+    resolver.decorate<IFeatureFlags, ScaledVersion>();
+
+    // (2 + 1) * 10, every resolve builds the whole chain
+    auto consumer = resolver.resolve<FlagsConsumer>();
+    ASSERT_EQ(consumer->flags->version(), 30);
+    ASSERT_NE(consumer->flags, resolver.resolve<FlagsConsumer>()->flags);
+    ASSERT_TRUE(resolver.sealed());
+
+    // inner bindings are not services of their own
+    ASSERT_EQ(resolver.size(), 2u);
+    ASSERT_EQ(resolver.memory_stats().services, 2u);
+
+    ASSERT_THROW((resolver.decorate<IFeatureFlags, VersionOffset<1>>()), dependency_resolver::duplicate_decorator_exception);
+    ASSERT_EQ(resolver.resolve<FlagsConsumer>()->flags->version(), 30);
+
+    // a removed service takes its decorators along
+    ASSERT_TRUE(resolver.remove<IFeatureFlags>());
+    ASSERT_EQ(resolver.size(), 1u);
+    resolver.add_transient<IFeatureFlags, FeatureFlags<4>>();
+    resolver.decorate<IFeatureFlags, VersionOffset<1>>();
+    ASSERT_EQ(resolver.resolve<FlagsConsumer>()->flags->version(), 5);
+
+    dependency_resolver empty;
+    ASSERT_THROW((empty.decorate<IFeatureFlags, VersionOffset<1>>()), dependency_resolver::dependency_not_found_exception);
+}
+
+TEST_F(DependencyResolverTest, TestDecoratedSingleton) {
+    resolver.add_singleton(1);
+    resolver.add_singleton<IFeatureFlags, FeatureFlags<3>>();
+    auto inner = resolver.resolve<FlagsConsumer>()->flags;
+
+    resolver.decorate<IFeatureFlags, VersionOffset<4>>();
+
+    auto outer = resolver.resolve<FlagsConsumer>()->flags;
+    ASSERT_EQ(outer->version(), 7);
+    ASSERT_EQ(outer, resolver.resolve<FlagsConsumer>()->flags);
+    ASSERT_EQ(std::static_pointer_cast<VersionOffset<4>>(outer)->inner, inner);
+}
+
+class PooledConnection {
+public:
+    static int created;
+    static int disposed;
+
+    explicit PooledConnection(std::shared_ptr<int> port) : port(port), open(false) { }
+
+    ~PooledConnection() {
+        EXPECT_FALSE(open);
+    }
+
+    void on_created() {
+        open = true;
+        ++created;
+    }
+
+    void on_disposed() {
+        open = false;
+        ++disposed;
+    }
+
+    std::shared_ptr<int> port;
+    bool open;
+};
+
+int PooledConnection::created = 0;
+int PooledConnection::disposed = 0;
+
+struct ConnectionServices {
+    std::shared_ptr<PooledConnection> connection;
+
+    void on_disposed() {
+        EXPECT_TRUE(connection->open);
+    }
+};
+
+TEST_F(DependencyResolverTest, TestLifecycleHooks) {
+    using namespace jaszyk::dependency_resolver_impl::utility;
+
+    static_assert(has_on_created<PooledConnection>::value && has_on_disposed<PooledConnection>::value, "Hooks must be found.");
+    static_assert(!has_on_created<ConnectionServices>::value && has_on_disposed<ConnectionServices>::value, "Hooks must be found.");
+    static_assert(!has_on_created<Controller>::value && !has_on_disposed<Controller>::value, "Types without hooks have none.");
+
+    PooledConnection::created = 0;
+    PooledConnection::disposed = 0;
+
+    resolver.add_singleton(5432);
+    resolver.add_scoped<PooledConnection>();
+
+    {
+        auto scope = resolver.make_scope();
+        auto services = resolver.resolve<ConnectionServices>(scope);
+        resolver.resolve<ConnectionServices>(scope);
+
+        ASSERT_TRUE(services->connection->open);
+        ASSERT_EQ(*services->connection->port, 5432);
+        ASSERT_EQ(PooledConnection::created, 1);
+        ASSERT_EQ(PooledConnection::disposed, 0);
+    }
+
+    ASSERT_EQ(PooledConnection::disposed, 1);
+
+    // singletons registered by value get the hooks of their copy
+    {
+        dependency_resolver values;
+        values.add_singleton(PooledConnection(std::make_shared<int>(5433)));
+
+        ASSERT_TRUE(values.resolve<ConnectionServices>()->connection->open);
+        ASSERT_EQ(PooledConnection::created, 2);
+        ASSERT_EQ(PooledConnection::disposed, 1);
+    }
+
+    ASSERT_EQ(PooledConnection::disposed, 2);
+}
+
+class SharedSession : public std::enable_shared_from_this<SharedSession> {
+public:
+    static int disposed;
+
+    void on_disposed() {
+        ++disposed;
+    }
+};
+
+int SharedSession::disposed = 0;
+
+TEST_F(DependencyResolverTest, TestLifecycleHooksSharedFromThis) {
+    using namespace jaszyk::dependency_resolver_impl::utility;
+
+    static_assert(shares_from_this<SharedSession>::value && !shares_from_this<PooledConnection>::value, "Self-sharing services must be found.");
+
+    SharedSession::disposed = 0;
+    resolver.add_transient<SharedSession>();
+
+    {
+        auto session = resolver.resolve<SharedSession>();
+        ASSERT_EQ(session->shared_from_this(), session);
+        ASSERT_EQ(SharedSession::disposed, 0);
+    }
+
+    ASSERT_EQ(SharedSession::disposed, 1);
+}
+
+class HostLog {
+public:
+    void add(const std::string& event) {
+        std::lock_guard<std::mutex> lock(mutex);
+        events.push_back(event);
+    }
+
+    std::size_t size() {
+        std::lock_guard<std::mutex> lock(mutex);
+        return events.size();
+    }
+
+    std::size_t position(const std::string& event) {
+        std::lock_guard<std::mutex> lock(mutex);
+        return std::find(events.begin(), events.end(), event) - events.begin();
+    }
+
+    std::mutex mutex;
+    std::vector<std::string> events;
+    std::atomic<int> starting{ 0 };
+};
+
+// services of the first level wait for each other, so they only start if started concurrently
+template <char Name>
+class LeafWorker {
+public:
+    explicit LeafWorker(std::shared_ptr<HostLog> log) : log(log) { }
+
+    void start() {
+        ++log->starting;
+        const auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+
+        while (log->starting < 2 && std::chrono::steady_clock::now() < deadline) {
+            std::this_thread::yield();
+        }
+
+        log->add(log->starting == 2 ? std::string("start ") + Name : "serial");
+    }
+
+    void stop() {
+        log->add(std::string("stop ") + Name);
+    }
+
+    std::shared_ptr<HostLog> log;
+};
+
+class Poller {
+public:
+    Poller(std::shared_ptr<HostLog> log, std::shared_ptr<LeafWorker<'a'>> broker) : log(log), broker(broker) { }
+
+    void start() {
+        log->add("start poller");
+    }
+
+    void stop() {
+        log->add("stop poller");
+    }
+
+    std::shared_ptr<HostLog> log;
+    std::shared_ptr<LeafWorker<'a'>> broker;
+};
+
+// not hosted, links Relay to LeafWorker<'b'>
+class Dispatcher {
+public:
+    explicit Dispatcher(std::shared_ptr<LeafWorker<'b'>> worker) : worker(worker) { }
+
+    std::shared_ptr<LeafWorker<'b'>> worker;
+};
+
+class Relay {
+public:
+    Relay(std::shared_ptr<HostLog> log, std::shared_ptr<Dispatcher> dispatcher) : log(log), dispatcher(dispatcher) { }
+
+    void start() {
+        if (fail) {
+            throw std::runtime_error("relay");
+        }
+
+        log->add("start relay");
+    }
+
+    void stop() {
+        log->add("stop relay");
+
+        while (block) {
+            std::this_thread::yield();
+        }
+
+        stopped = true;
+    }
+
+    std::shared_ptr<HostLog> log;
+    std::shared_ptr<Dispatcher> dispatcher;
+    bool fail = false;
+    std::atomic<bool> block{ false };
+    std::atomic<bool> stopped{ false };
+};
+
+TEST_F(DependencyResolverTest, TestHostedServices) {
+    using namespace jaszyk::dependency_resolver_impl::utility;
+
+    static_assert(is_hosted_service<Poller>::value && !is_hosted_service<Dispatcher>::value, "Hosted services have start and stop.");
+
+    resolver.add_singleton<HostLog>();
+    resolver.add_singleton<LeafWorker<'a'>>();
+    resolver.add_singleton<LeafWorker<'b'>>();
+    resolver.add_transient<Dispatcher>();
+    resolver.add_singleton<Relay>();
+    resolver.add_singleton<Poller>();
+
+    auto log = resolver.resolve<Poller>()->log;
+
+    resolver.start_hosted_services();
+    ASSERT_EQ(log->size(), 4u);
+    ASSERT_LT(log->position("start a"), log->position("start poller"));
+    ASSERT_LT(log->position("start b"), log->position("start relay"));
+
+    ASSERT_TRUE(resolver.stop_hosted_services(std::chrono::seconds(5)));
+    ASSERT_EQ(log->size(), 8u);
+    ASSERT_LT(log->position("stop poller"), log->position("stop a"));
+    ASSERT_LT(log->position("stop relay"), log->position("stop b"));
+
+    // nothing is running anymore
+    ASSERT_TRUE(resolver.stop_hosted_services(std::chrono::seconds(0)));
+    ASSERT_EQ(log->size(), 8u);
+}
+
+TEST_F(DependencyResolverTest, TestHostedServicesDeadline) {
+    resolver.add_singleton<HostLog>();
+    resolver.add_singleton<LeafWorker<'a'>>();
+    resolver.add_singleton<LeafWorker<'b'>>();
+    resolver.add_transient<Dispatcher>();
+    resolver.add_singleton<Relay>();
+
+    auto relay = resolver.resolve_all<Relay>().front();
+    auto log = relay->log;
+
+    relay->fail = true;
+    ASSERT_THROW(resolver.start_hosted_services(), std::runtime_error);
+    ASSERT_LT(log->position("stop a"), log->size());
+    ASSERT_LT(log->position("stop b"), log->size());
+    ASSERT_EQ(log->position("stop relay"), log->size());
+
+    relay->fail = false;
+    relay->block = true;
+    log->events.clear();
+    log->starting = 0;
+    resolver.start_hosted_services();
+
+    // Relay is still stopping, so the services it depends on are left running
+    ASSERT_FALSE(resolver.stop_hosted_services(std::chrono::milliseconds(20)));
+    ASSERT_EQ(log->position("stop b"), log->size());
+
+    // they stop in order once it is done, and the next stop waits for them
+    relay->block = false;
+    ASSERT_TRUE(resolver.stop_hosted_services(std::chrono::seconds(5)));
+    ASSERT_TRUE(relay->stopped);
+    ASSERT_LT(log->position("stop relay"), log->position("stop b"));
+    ASSERT_LT(log->position("stop a"), log->size());
+}
+
+TEST_F(DependencyResolverTest, TestHostedServicesBindings) {
+    resolver.add_singleton<HostLog>();
+    resolver.add_singleton<LeafWorker<'a'>>();
+    resolver.add_singleton<LeafWorker<'b'>>();
+
+    auto log = resolver.resolve_all<HostLog>().front();
+    resolver.start_hosted_services();
+    ASSERT_EQ(log->size(), 2u);
+
+    // a clone shares the services and whether they run, so they stop once
+    dependency_resolver copy = resolver.clone();
+    ASSERT_TRUE(copy.stop_hosted_services(std::chrono::seconds(5)));
+    ASSERT_TRUE(resolver.stop_hosted_services(std::chrono::seconds(5)));
+    ASSERT_EQ(log->size(), 4u);
+
+    resolver.start_hosted_services();
+    ASSERT_EQ(log->size(), 6u);
+
+    // dropped with its binding, stopped by the last resolver hosting it
+    resolver.remove<LeafWorker<'a'>>();
+    ASSERT_EQ(log->size(), 6u);
+    copy.remove<LeafWorker<'a'>>();
+    ASSERT_EQ(log->size(), 7u);
+    ASSERT_EQ(log->events.back(), "stop a");
+
+    // the replacement isn't started, the replaced one is still hosted by the clone
+    resolver.set_registration_policy(dependency_resolver::registration_policy::replace);
+    resolver.add_singleton<LeafWorker<'b'>>();
+    ASSERT_TRUE(resolver.stop_hosted_services(std::chrono::seconds(5)));
+    ASSERT_EQ(log->size(), 7u);
+
+    ASSERT_TRUE(copy.stop_hosted_services(std::chrono::seconds(5)));
+    ASSERT_EQ(log->size(), 8u);
+    ASSERT_EQ(log->events.back(), "stop b");
+}
+
+struct FlagStore {
+    std::atomic<int> builds{ 0 };
+    std::atomic<bool> failing{ false };
+};
+
+struct IFlagSnapshot {
+    virtual ~IFlagSnapshot() = default;
+    virtual int version() const = 0;
+};
+
+struct FlagSnapshot : IFlagSnapshot {
+    FlagSnapshot(std::shared_ptr<FlagStore> store) {
+        if (store->failing) {
+            throw std::runtime_error("flag store is unavailable");
+        }
+
+        version_ = ++store->builds;
+    }
+
+    int version() const override {
+        return version_;
+    }
+
+    int version_;
+};
+
+struct FlagClient {
+    FlagClient(std::shared_ptr<IFlagSnapshot> snapshot) : snapshot(snapshot) {}
+
+    std::shared_ptr<IFlagSnapshot> snapshot;
+};
+
+struct FlagReader {
+    FlagReader(std::shared_ptr<FlagSnapshot> snapshot) : snapshot(snapshot) {}
+
+    std::shared_ptr<FlagSnapshot> snapshot;
+};
+
+// polls condition until it holds or timeout runs out
+template <typename TCondition>
+bool eventually(TCondition condition, std::chrono::milliseconds timeout = std::chrono::seconds(10)) {
+    const auto deadline = std::chrono::steady_clock::now() + timeout;
+
+    while (!condition()) {
+        if (std::chrono::steady_clock::now() > deadline) {
+            return false;
+        }
+
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    }
+
+    return true;
+}
+
+TEST_F(DependencyResolverTest, TestExpiringServices) {
+    resolver.add_singleton<FlagStore>();
+    resolver.add_expiring<IFlagSnapshot, FlagSnapshot>(std::chrono::hours(1));
+    resolver.add_transient<FlagClient>();
+
+    auto store = resolver.resolve_all<FlagStore>().front();
+    ASSERT_EQ(store->builds, 1);
+
+    auto first = resolver.resolve<FlagClient>()->snapshot;
+    ASSERT_EQ(first, resolver.resolve<FlagClient>()->snapshot);
+
+    // rebuilt on request, resolves only pick up the new instance
+    resolver.refresh_expiring_services();
+    ASSERT_EQ(resolver.resolve<FlagClient>()->snapshot->version(), 2);
+    ASSERT_EQ(first->version(), 1);
+
+    // a failed rebuild keeps the previous instance
+    store->failing = true;
+    ASSERT_THROW(resolver.refresh_expiring_services(), std::runtime_error);
+    ASSERT_EQ(resolver.resolve<FlagClient>()->snapshot->version(), 2);
+
+    store->failing = false;
+    resolver.refresh_expiring_services();
+    ASSERT_EQ(resolver.resolve<FlagClient>()->snapshot->version(), 3);
+
+    // a binding kept by the registration policy isn't built
+    resolver.add_expiring<IFlagSnapshot, FlagSnapshot>(std::chrono::hours(1));
+    ASSERT_EQ(store->builds, 3);
+
+    // resolves racing with rebuilds see every instance at most once, in order
+    std::atomic<bool> stop{ false };
+    std::atomic<int> failures{ 0 };
+    std::vector<std::thread> readers;
+
+    for (int i = 0; i < 4; ++i) {
+        readers.emplace_back([&] {
+            int last = 0;
+
+            while (!stop.load()) {
+                const int version = resolver.resolve<FlagClient>()->snapshot->version();
+
+                if (version < last) {
+                    ++failures;
+                }
+
+                last = version;
+            }
+        });
+    }
+
+    for (int i = 0; i < 200; ++i) {
+        resolver.refresh_expiring_services();
+    }
+
+    stop = true;
+
+    for (auto& reader : readers) {
+        reader.join();
+    }
+
+    ASSERT_EQ(failures.load(), 0);
+    ASSERT_EQ(resolver.resolve<FlagClient>()->snapshot->version(), 203);
+}
+
+TEST_F(DependencyResolverTest, TestExpiringServicesRefresher) {
+    std::shared_ptr<FlagStore> store;
+
+    {
+        dependency_resolver local;
+        local.add_singleton<FlagStore>();
+        store = local.resolve_all<FlagStore>().front();
+        local.add_expiring<FlagSnapshot>(std::chrono::milliseconds(40));
+
+        // rebuilt ahead of expiry with nobody resolving it
+        ASSERT_TRUE(eventually([&] { return store->builds >= 4; }));
+
+        // handed to the moved-to resolver
+        dependency_resolver moved(std::move(local));
+        int built = store->builds;
+        ASSERT_TRUE(eventually([&] { return store->builds >= built + 3; }));
+
+        // registrations rebinding and removing services while the refresher rebuilds
+        moved.set_registration_policy(dependency_resolver::registration_policy::replace);
+
+        for (int i = 0; i < 200; ++i) {
+            moved.add_transient<FlagReader>();
+            ASSERT_NE(moved.resolve<FlagReader>(), nullptr);
+            moved.remove<FlagReader>();
+        }
+
+        // a clone rebuilds the service it shares once the original is gone
+        dependency_resolver assigned;
+        assigned = moved.clone();
+        { dependency_resolver gone(std::move(moved)); }
+
+        built = store->builds;
+        ASSERT_TRUE(eventually([&] { return store->builds >= built + 3; }));
+    }
+
+    // nothing of the resolvers, their refreshers included, outlives them
+    ASSERT_EQ(store.use_count(), 1);
+}
+
+struct GrammarCounter {
+    std::atomic<int> built{ 0 };
+};
+
+struct IGrammar {
+    virtual ~IGrammar() = default;
+};
+
+struct Grammar : IGrammar {
+    Grammar(std::shared_ptr<GrammarCounter> counter) {
+        ++counter->built;
+    }
+};
+
+struct Parser {
+    Parser(std::shared_ptr<IGrammar> grammar) : grammar(grammar) {}
+
+    std::shared_ptr<IGrammar> grammar;
+};
+
+TEST_F(DependencyResolverTest, TestWeakCachedServices) {
+    resolver.add_singleton<GrammarCounter>();
+    resolver.add_weak_cached<IGrammar, Grammar>();
+    resolver.add_transient<Parser>();
+
+    auto counter = resolver.resolve_all<GrammarCounter>().front();
+
+    auto first = resolver.resolve<Parser>();
+    auto second = resolver.resolve<Parser>();
+    ASSERT_EQ(first->grammar, second->grammar);
+    ASSERT_EQ(counter->built, 1);
+
+    first.reset();
+    ASSERT_EQ(resolver.resolve<Parser>()->grammar, second->grammar);
+
+    // rebuilt only once nobody holds it
+    std::weak_ptr<IGrammar> released = second->grammar;
+    second.reset();
+    ASSERT_TRUE(released.expired());
+    ASSERT_NE(resolver.resolve<Parser>(), nullptr);
+    ASSERT_EQ(counter->built, 2);
+
+    std::vector<std::shared_ptr<Parser>> parsers(8);
+    std::vector<std::thread> threads;
+
+    for (auto& parser : parsers) {
+        threads.emplace_back([&parser, this] { parser = resolver.resolve<Parser>(); });
+    }
+
+    for (auto& thread : threads) {
+        thread.join();
+    }
+
+    for (const auto& parser : parsers) {
+        ASSERT_EQ(parser->grammar, parsers.front()->grammar);
+    }
+
+    // shared across scopes, so it can't hold a scoped service
+    dependency_resolver scoped;
+    scoped.add_scoped<GrammarCounter>();
+    scoped.add_weak_cached<IGrammar, Grammar>();
+    scoped.add_transient<Parser>();
+
+    auto scope = scoped.make_scope();
+    ASSERT_THROW(scoped.resolve<Parser>(scope), dependency_resolver::scoped_dependency_exception);
+}
 
 // Run the tests
 int main(int argc, char** argv) {
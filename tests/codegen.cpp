@@ -0,0 +1,56 @@
+#include <gtest/gtest.h>
+#include <dependency_resolver.hpp>
+#include "generated_wiring.hpp"
+
+using jaszyk::dependency_resolver;
+
+TEST(CodegenTest, TestGeneratedWiringMatchesResolver) {
+    auto config = std::make_shared<Config>();
+    config->retries = 5;
+
+    dependency_resolver resolver;
+    resolver.add_singleton(*config);
+    resolver.add_singleton<ILogger, Logger>();
+    resolver.add_scoped<IRepository, Repository>();
+    resolver.add_transient<Handler>();
+    resolver.add_transient<Services>();
+    resolver.add_transient<BundledHandler>();
+
+    generated::wiring wiring(config);
+
+    auto scope = resolver.make_scope();
+    generated::wiring::scope generated_scope;
+
+    for (int i = 0; i < 3; ++i) {
+        ASSERT_EQ(wiring.resolve_Handler(generated_scope)->handle(), resolver.resolve<Handler>(scope)->handle());
+    }
+
+    ASSERT_EQ(wiring.resolve_ILogger(), wiring.resolve_ILogger());
+    ASSERT_EQ(wiring.resolve_IRepository(generated_scope), wiring.resolve_IRepository(generated_scope));
+
+    generated::wiring::scope other_scope;
+    ASSERT_EQ(wiring.resolve_Handler(other_scope)->handle(), "logger5:1");
+
+    auto services = wiring.resolve_Services(other_scope);
+    ASSERT_EQ(services->logger, wiring.resolve_ILogger());
+    ASSERT_EQ(services->repository, wiring.resolve_IRepository(other_scope));
+    ASSERT_EQ(resolver.resolve<Services>(scope)->logger->name(), "logger5");
+
+    // the bundle is bound implicitly and shared within the scope, as in the resolver
+    auto bundled = wiring.resolve_BundledHandler(other_scope);
+    ASSERT_EQ(bundled->services(), wiring.resolve_BundledHandler(other_scope)->services());
+    ASSERT_EQ(bundled->services()->repository, wiring.resolve_IRepository(other_scope));
+    ASSERT_EQ(resolver.resolve<BundledHandler>(scope)->services(), resolver.resolve<BundledHandler>(scope)->services());
+
+    // lifecycle hooks run as in the resolver: on_created once built, on_disposed from the deleter
+    auto audit = wiring.resolve_AuditLog();
+    ASSERT_EQ(config->created, 1);
+    ASSERT_EQ(config->disposed, 0);
+    audit.reset();
+    ASSERT_EQ(config->disposed, 1);
+}
+
+int main(int argc, char** argv) {
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
@@ -0,0 +1,15 @@
+#pragma once
+#include <dependency_resolver_codegen.hpp>
+#include "codegen_services.hpp"
+
+JASZYK_DEPENDENCY_MANIFEST(manifest) {
+    manifest.include("codegen_services.hpp");
+
+    JASZYK_MANIFEST_INSTANCE(manifest, Config);
+    JASZYK_MANIFEST_SINGLETON(manifest, ILogger, Logger);
+    JASZYK_MANIFEST_SCOPED(manifest, IRepository, Repository);
+    JASZYK_MANIFEST_TRANSIENT(manifest, Handler, Handler);
+    JASZYK_MANIFEST_TRANSIENT(manifest, Services, Services);
+    JASZYK_MANIFEST_TRANSIENT(manifest, BundledHandler, BundledHandler);
+    JASZYK_MANIFEST_TRANSIENT(manifest, AuditLog, AuditLog);
+}
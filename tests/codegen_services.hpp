@@ -0,0 +1,106 @@
+#pragma once
+#include <dependency_resolver.hpp>
+#include <memory>
+#include <mutex>
+#include <string>
+
+struct Config {
+    int retries = 3;
+    int created = 0;
+    int disposed = 0;
+};
+
+class ILogger {
+public:
+    virtual ~ILogger() = default;
+    virtual std::string name() const = 0;
+};
+
+class Logger : public ILogger {
+    std::shared_ptr<Config> config_;
+public:
+    Logger(std::shared_ptr<Config> config)
+        : config_(config)
+    { }
+
+    std::string name() const override {
+        return "logger" + std::to_string(config_->retries);
+    }
+};
+
+class IRepository {
+public:
+    virtual ~IRepository() = default;
+    virtual int next_id() = 0;
+};
+
+class Repository : public IRepository {
+    std::shared_ptr<ILogger> logger_;
+    int id_ = 0;
+public:
+    Repository(std::shared_ptr<ILogger> logger)
+        : logger_(logger)
+    { }
+
+    int next_id() override {
+        return ++id_;
+    }
+};
+
+class Handler {
+    std::shared_ptr<IRepository> repository_;
+    std::shared_ptr<ILogger> logger_;
+public:
+    Handler(std::shared_ptr<IRepository> repository, std::shared_ptr<ILogger> logger)
+        : repository_(repository)
+        , logger_(logger)
+    { }
+
+    std::string handle() {
+        return logger_->name() + ":" + std::to_string(repository_->next_id());
+    }
+};
+
+// aggregate, brace-initialized with its dependencies; the mutex keeps it from being moved
+struct Services {
+    std::shared_ptr<ILogger> logger;
+    std::shared_ptr<IRepository> repository;
+    std::mutex mutex;
+};
+
+// lifecycle hooks, called by the generated wiring as by the resolver
+class AuditLog {
+    std::shared_ptr<Config> config_;
+public:
+    AuditLog(std::shared_ptr<Config> config)
+        : config_(config)
+    { }
+
+    void on_created() {
+        ++config_->created;
+    }
+
+    void on_disposed() {
+        ++config_->disposed;
+    }
+};
+
+// dependency bundle, registered implicitly in the manifest
+struct HandlerServices {
+    using dependency_bundle = jaszyk::dependency_resolver::scoped_bundle;
+
+    std::shared_ptr<ILogger> logger;
+    std::shared_ptr<IRepository> repository;
+};
+
+class BundledHandler {
+    std::shared_ptr<HandlerServices> services_;
+public:
+    BundledHandler(std::shared_ptr<HandlerServices> services)
+        : services_(services)
+    { }
+
+    const std::shared_ptr<HandlerServices>& services() const {
+        return services_;
+    }
+};
@@ -0,0 +1,66 @@
+#include <gtest/gtest.h>
+#include <dependency_resolver.hpp>
+#include <string>
+#include <typeinfo>
+#include <vector>
+
+using jaszyk::dependency_resolver;
+
+class IClock {
+public:
+    virtual ~IClock() = default;
+    virtual int now() const = 0;
+};
+
+class Clock : public IClock {
+public:
+    int now() const override {
+        return 42;
+    }
+};
+
+class Session {
+public:
+    explicit Session(std::shared_ptr<IClock> clock) : clock(clock) { }
+
+    std::shared_ptr<IClock> clock;
+};
+
+class Request {
+public:
+    Request(std::shared_ptr<Session> session, std::shared_ptr<IClock> clock) : session(session), clock(clock) { }
+
+    std::shared_ptr<Session> session;
+    std::shared_ptr<IClock> clock;
+};
+
+TEST(DiagnosticsTest, TestObserversSeeConstructedServices) {
+    std::vector<std::string> created;
+
+    dependency_resolver resolver;
+    resolver.add_observer([&](const char* name, const std::shared_ptr<void>& instance) {
+        ASSERT_NE(instance, nullptr);
+        created.push_back(name);
+    });
+
+    resolver.add_singleton<IClock, Clock>();
+    resolver.add_scoped<Session>();
+
+    auto scope = resolver.make_scope();
+    resolver.resolve<Request>(scope);
+    resolver.resolve<Request>(scope);
+
+    const std::vector<std::string> expected = {
+        typeid(Clock).name(),       // the singleton, built when registered
+        typeid(Session).name(),     // once per scope
+        typeid(Request).name(),
+        typeid(Request).name()
+    };
+
+    ASSERT_EQ(created, expected);
+}
+
+int main(int argc, char** argv) {
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
@@ -0,0 +1,33 @@
+#include <gtest/gtest.h>
+#include <dependency_resolver.hpp>
+
+#include "multi_tu_services.hpp"
+
+using namespace jaszyk;
+
+namespace multi_tu {
+
+    void register_clock(dependency_resolver& resolver) {
+        resolver.add_singleton<IClock, FixedClock>();
+    }
+
+} // namespace multi_tu
+
+TEST(MultiTranslationUnit, ServicesRegisteredInOtherUnitResolve) {
+    dependency_resolver resolver;
+    multi_tu::register_clock(resolver);
+    resolver.seal<multi_tu::Reporter>();
+
+    auto reporter = resolver.resolve<multi_tu::Reporter>();
+    EXPECT_EQ(reporter->report(), 42);
+    EXPECT_EQ(reporter->clock(), resolver.resolve<multi_tu::Reporter>()->clock());
+}
+
+TEST(MultiTranslationUnit, GlobalScopeIsShared) {
+    dependency_resolver resolver;
+    multi_tu::register_scoped_clock(resolver);
+
+    auto reporter = resolver.resolve<multi_tu::Reporter>(dependency_resolver::global_scope);
+    EXPECT_EQ(reporter->clock(), multi_tu::resolve_in_global_scope(resolver)->clock());
+    EXPECT_EQ(&dependency_resolver::global_scope, multi_tu::global_scope_address());
+}
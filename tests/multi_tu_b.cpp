@@ -0,0 +1,21 @@
+#include <dependency_resolver.hpp>
+
+#include "multi_tu_services.hpp"
+
+using namespace jaszyk;
+
+namespace multi_tu {
+
+    void register_scoped_clock(dependency_resolver& resolver) {
+        resolver.add_scoped<IClock, FixedClock>();
+    }
+
+    std::shared_ptr<Reporter> resolve_in_global_scope(dependency_resolver& resolver) {
+        return resolver.resolve<Reporter>(dependency_resolver::global_scope);
+    }
+
+    const void* global_scope_address() {
+        return &dependency_resolver::global_scope;
+    }
+
+} // namespace multi_tu
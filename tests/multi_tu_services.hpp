@@ -0,0 +1,33 @@
+#pragma once
+#include <memory>
+
+#include <dependency_resolver_fwd.hpp>
+
+namespace multi_tu {
+
+    class IClock {
+    public:
+        virtual ~IClock() = default;
+        virtual int now() const = 0;
+    };
+
+    class FixedClock : public IClock {
+    public:
+        int now() const override { return 42; }
+    };
+
+    class Reporter {
+    public:
+        explicit Reporter(std::shared_ptr<IClock> clock) : clock_(clock) {}
+        int report() const { return clock_->now(); }
+        std::shared_ptr<IClock> clock() const { return clock_; }
+    private:
+        std::shared_ptr<IClock> clock_;
+    };
+
+    void register_clock(jaszyk::dependency_resolver& resolver);
+    void register_scoped_clock(jaszyk::dependency_resolver& resolver);
+    std::shared_ptr<Reporter> resolve_in_global_scope(jaszyk::dependency_resolver& resolver);
+    const void* global_scope_address();
+
+} // namespace multi_tu
@@ -0,0 +1,22 @@
+#include <dependency_resolver_plugin.hpp>
+#include "plugin_services.hpp"
+
+namespace {
+
+class Greeter : public IGreeter {
+    std::shared_ptr<GreeterSettings> settings_;
+public:
+    Greeter(std::shared_ptr<GreeterSettings> settings)
+        : settings_(settings)
+    { }
+
+    std::string greet() const override {
+        return "Hello " + settings_->name;
+    }
+};
+
+}
+
+JASZYK_DEPENDENCY_PLUGIN(registrar) {
+    registrar.add_transient<IGreeter, Greeter>();
+}
@@ -0,0 +1,14 @@
+#pragma once
+#include <memory>
+#include <string>
+
+// shared by the host and the greeter plugin
+class IGreeter {
+public:
+    virtual ~IGreeter() = default;
+    virtual std::string greet() const = 0;
+};
+
+struct GreeterSettings {
+    std::string name;
+};
@@ -0,0 +1,45 @@
+#include <gtest/gtest.h>
+#include <dependency_resolver_plugin.hpp>
+#include "plugin_services.hpp"
+
+using jaszyk::dependency_resolver;
+
+class GreeterUser {
+    std::shared_ptr<IGreeter> greeter_;
+public:
+    GreeterUser(std::shared_ptr<IGreeter> greeter)
+        : greeter_(greeter)
+    { }
+
+    std::string greet() const {
+        return greeter_->greet();
+    }
+};
+
+TEST(PluginTest, TestPluginRegistrationsAreMergedIntoSealedResolver) {
+    // plugins must outlive the resolver holding their factories
+    std::vector<jaszyk::plugin> plugins;
+    dependency_resolver resolver;
+
+    resolver.add_singleton(GreeterSettings{ "World" });
+    resolver.seal<>();
+
+    plugins = jaszyk::load_plugins<GreeterUser>(resolver, { JASZYK_TEST_PLUGIN });
+
+    ASSERT_EQ(plugins.size(), 1u);
+    ASSERT_TRUE(resolver.sealed());
+    ASSERT_TRUE(resolver.prepared<GreeterUser>());
+    ASSERT_EQ(resolver.resolve<GreeterUser>()->greet(), "Hello World");
+}
+
+TEST(PluginTest, TestMissingPlugin) {
+    dependency_resolver resolver;
+
+    ASSERT_THROW(jaszyk::load_plugins(resolver, { "missing_plugin.so" }), jaszyk::plugin_load_exception);
+    ASSERT_EQ(resolver.size(), 0u);
+}
+
+int main(int argc, char** argv) {
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
@@ -0,0 +1,35 @@
+// Wiring generator driver.
+// Compiled once per manifest: JASZYK_DEPENDENCY_MANIFEST_HEADER names the manifest header.
+//
+// Usage: generate_wiring <output header> <namespace>
+#include <dependency_resolver_codegen.hpp>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+#include JASZYK_DEPENDENCY_MANIFEST_HEADER
+
+int main(int argc, char** argv) {
+    if (argc != 3) {
+        std::cerr << "usage: " << argv[0] << " <output header> <namespace>\n";
+        return 2;
+    }
+
+    jaszyk::codegen::manifest manifest;
+    jaszyk_describe_services(manifest);
+
+    std::ostringstream header;
+
+    try {
+        manifest.write(header, argv[2]);
+    }
+    catch (const std::exception& e) {
+        std::cerr << argv[0] << ": " << e.what() << "\n";
+        return 1;
+    }
+
+    std::ofstream out(argv[1], std::ios::binary);
+    out << header.str();
+
+    return out ? 0 : 1;
+}